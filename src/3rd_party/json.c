@@ -472,12 +472,14 @@ json_string_automaton(JSON_PARSER* parser, const char* input, size_t size,
     if(type == JSON_KEY) {
         ignore_ill_utf8 = (parser->config.flags & JSON_IGNOREILLUTF8KEY);
         fix_ill_utf8 = (parser->config.flags & JSON_FIXILLUTF8KEY);
-        max_len = parser->config.max_key_len + 1;       /* +1 fir final quotes. */
+        max_len = parser->config.max_key_len;
     } else {
         ignore_ill_utf8 = (parser->config.flags & JSON_IGNOREILLUTF8VALUE);
         fix_ill_utf8 = (parser->config.flags & JSON_FIXILLUTF8VALUE);
-        max_len = parser->config.max_string_len + 1;    /* +1 fir final quotes. */
+        max_len = parser->config.max_string_len;
     }
+    if(max_len != 0)
+        max_len++;      /* +1 fir final quotes. */
 
     if(max_len != 0  &&  parser->pos.offset - parser->value_pos.offset + size > max_len)
         size = max_len - (parser->pos.offset - parser->value_pos.offset) + 1;
@@ -1165,11 +1167,13 @@ json_dump_int64(int64_t i64, int (*write_func)(const char*, size_t, void*), void
     char buffer[32];
     size_t off = sizeof(buffer);
     int is_neg = (i64 < 0);
+    /* (Work with the magnitude, so it works also for INT64_MIN.) */
+    uint64_t u64 = (is_neg ? ~((uint64_t) i64) + 1 : (uint64_t) i64);
 
-    while(i64 != 0) {
-        buffer[--off] = '0' + (i64 % 10);
-        i64 /= 10;
-    }
+    do {
+        buffer[--off] = '0' + (u64 % 10);
+        u64 /= 10;
+    } while(u64 != 0);
 
     if(is_neg)
         buffer[--off] = '-';
@@ -1183,10 +1187,10 @@ json_dump_uint64(uint64_t u64, int (*write_func)(const char*, size_t, void*), vo
     char buffer[32];
     size_t off = sizeof(buffer);
 
-    while(u64 != 0) {
+    do {
         buffer[--off] = '0' + (u64 % 10);
         u64 /= 10;
-    }
+    } while(u64 != 0);
 
     return write_func(buffer + off, sizeof(buffer) - off, user_data);
 }
@@ -0,0 +1,127 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "arena.h"
+
+
+/* Chunks start small so that arenas of small (e.g. partial) stores do not
+ * waste memory, and grow up to this size. */
+#define ARENA_MIN_CHUNK_SIZE    (4 * 1024)
+#define ARENA_MAX_CHUNK_SIZE    (1024 * 1024)
+
+#define ARENA_ALIGN(size)       (((size) + (sizeof(void*) - 1)) & ~(sizeof(void*) - 1))
+
+
+struct ARENA_CHUNK {
+    ARENA_CHUNK* next;
+    size_t size;
+    /* Data follow. (The header size keeps them aligned.) */
+};
+
+
+void
+arena_init(ARENA* arena)
+{
+    arena->chunks = NULL;
+    arena->ptr = NULL;
+    arena->end = NULL;
+    arena->chunk_size = ARENA_MIN_CHUNK_SIZE;
+    arena->total_size = 0;
+}
+
+void
+arena_fini(ARENA* arena)
+{
+    ARENA_CHUNK* chunk;
+
+    while(arena->chunks != NULL) {
+        chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        free(chunk);
+    }
+
+    arena_init(arena);
+}
+
+static void*
+arena_alloc_chunk(ARENA* arena, size_t size)
+{
+    ARENA_CHUNK* chunk;
+
+    chunk = (ARENA_CHUNK*) malloc(sizeof(ARENA_CHUNK) + size);
+    CHECK(chunk != NULL);
+    chunk->size = size;
+    arena->total_size += size;
+    return chunk;
+}
+
+void*
+arena_alloc(ARENA* arena, size_t size)
+{
+    ARENA_CHUNK* chunk;
+    void* ptr;
+
+    size = ARENA_ALIGN(size);
+
+    if(size > (size_t) (arena->end - arena->ptr)) {
+        if(size > arena->chunk_size / 4) {
+            /* Big allocations get a chunk of their own so we do not throw
+             * away the rest of the current chunk. Put it behind the current
+             * one, which stays current. */
+            chunk = arena_alloc_chunk(arena, size);
+            if(arena->chunks != NULL) {
+                chunk->next = arena->chunks->next;
+                arena->chunks->next = chunk;
+            } else {
+                chunk->next = NULL;
+                arena->chunks = chunk;
+            }
+            return (void*) (chunk + 1);
+        }
+
+        chunk = arena_alloc_chunk(arena, arena->chunk_size);
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->ptr = (char*) (chunk + 1);
+        arena->end = arena->ptr + chunk->size;
+        if(arena->chunk_size < ARENA_MAX_CHUNK_SIZE)
+            arena->chunk_size *= 2;
+    }
+
+    ptr = arena->ptr;
+    arena->ptr += size;
+    return ptr;
+}
+
+char*
+arena_strdup(ARENA* arena, const char* str)
+{
+    size_t len = strlen(str);
+    char* copy;
+
+    copy = (char*) arena_alloc(arena, len + 1);
+    memcpy(copy, str, len + 1);
+    return copy;
+}
@@ -0,0 +1,76 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_ARENA_H
+#define DOCBAKER_ARENA_H
+
+#include "misc.h"
+
+
+/* Arena (a.k.a. region) allocator.
+ *
+ * Memory is handed out from big chunks by just bumping a pointer, and it is
+ * never released individually: arena_fini() releases all the chunks at once.
+ * This suits data which live exactly as long as some bigger structure (like
+ * all the names in the store), as it avoids the per-allocation overhead of
+ * malloc() both in time and in memory.
+ *
+ * The arena is not thread-safe.
+ */
+
+
+typedef struct ARENA_CHUNK ARENA_CHUNK;
+
+typedef struct ARENA {
+    ARENA_CHUNK* chunks;
+    char* ptr;
+    char* end;
+    size_t chunk_size;          /* Size of the next chunk. */
+    size_t total_size;          /* Sum of sizes of all the chunks. */
+} ARENA;
+
+
+#define ARENA_INITIALIZER       { NULL, NULL, NULL, 0, 0 }
+
+
+void arena_init(ARENA* arena);
+void arena_fini(ARENA* arena);
+
+/* Allocate the memory. The returned memory is aligned for any type. Never
+ * returns NULL (aborts the program on an allocation failure). */
+void* arena_alloc(ARENA* arena, size_t size);
+
+/* Copy the string into the arena. */
+char* arena_strdup(ARENA* arena, const char* str);
+
+/* How much memory the arena holds. */
+static inline size_t
+arena_size(const ARENA* arena)
+{
+    return arena->total_size;
+}
+
+
+#endif  /* DOCBAKER_ARENA_H */
@@ -0,0 +1,855 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "cache.h"
+#include "array.h"
+#include "cache_backend.h"
+#include "fnv1a.h"
+#include "htable.h"
+#include "json-dom.h"
+#include "path_util.h"
+#include "store.h"
+#include "thread_util.h"
+
+#include <time.h>
+
+
+/* Bump this whenever the format of the cache entries changes. */
+#define CACHE_FORMAT_VERSION        4
+
+#define CACHE_STAT_INDEX            "stat-index"
+#define CACHE_STATS_LOG             "stats-log"
+#define CACHE_LAST_RUN              "last-run"
+
+/* Prefetching (for remote backends only). */
+#define CACHE_PREFETCH_THREADS      8
+#define CACHE_PREFETCH_BATCH        32
+
+
+typedef struct CACHE_STAT_ENTRY {
+    uint64_t mtime;
+    uint64_t size;
+    uint64_t ino;
+    uint64_t content_hash;
+    int is_racy;
+    char path[1];
+} CACHE_STAT_ENTRY;
+
+
+/* Item of the prefetch queue. */
+typedef struct CACHE_PREFETCH {
+    struct stat st;
+    int is_done;
+    int result;                 /* CACHE_BACKEND_xxxx */
+    BUFFER data;
+    char path[1];
+} CACHE_PREFETCH;
+
+
+static CACHE_BACKEND* cache_backend = NULL;
+
+/* Local directory for the stat index and statistics. (Empty if we use only
+ * a remote backend.) Leave some space for names of the files in it. */
+static char cache_dir[PATH_MAX - 64];
+static uint64_t cache_options_hash;         /* All key components but the file. */
+static uint64_t cache_cmdline_hash;         /* libclang command line. */
+static uint64_t cache_tool_hash;            /* DocBaker version and entry format. */
+static uint64_t cache_size_limit;
+
+/* Key components of the previous run, so we can tell which of them has
+ * changed when an entry is not found. */
+static int cache_has_last_run = 0;
+static uint64_t cache_last_cmdline_hash;
+static uint64_t cache_last_tool_hash;
+
+/* Stat index as loaded from the cache directory. It is read-only during the
+ * run so it can be used without any locking. */
+static HTABLE cache_stat_index = HTABLE_INITIALIZER;
+static ARRAY cache_stat_old_entries = ARRAY_INITIALIZER;
+
+/* Stat entries of files we had to (re)hash during this run. As the same
+ * header is typically included by many input files, we also keep them in a
+ * hash table so each file is hashed at most once per run. Guarded by the
+ * cache_mutex. */
+static ARRAY cache_stat_new_entries = ARRAY_INITIALIZER;
+static HTABLE cache_stat_new_index = HTABLE_INITIALIZER;
+
+static unsigned cache_n_hits = 0;
+static unsigned cache_n_misses = 0;
+static unsigned cache_n_saved = 0;
+
+static MUTEX cache_mutex;
+
+/* For a remote backend, the walker announces each input file with
+ * cache_prefetch() and the prefetch threads fetch the entries in the
+ * background, so the round-trips overlap with the walk and the parsing.
+ * Guarded by the cache_mutex. */
+static THREAD cache_prefetch_threads[CACHE_PREFETCH_THREADS];
+static int cache_prefetch_enabled = 0;
+static int cache_prefetch_closed = 0;
+static HTABLE cache_prefetch_index = HTABLE_INITIALIZER;
+static ARRAY cache_prefetch_queue = ARRAY_INITIALIZER;
+static size_t cache_prefetch_queue_head = 0;
+static ARRAY cache_prefetch_items = ARRAY_INITIALIZER;
+static CONDVAR cache_prefetch_has_work;
+static CONDVAR cache_prefetch_has_done;
+
+
+static uint64_t
+cache_path_hash(const char* path)
+{
+    return fnv1a_64(FNV1A_BASE_64, path, strlen(path));
+}
+
+static int
+cache_stat_entry_cmp(const void* item, const void* key)
+{
+    return strcmp(((const CACHE_STAT_ENTRY*) item)->path, (const char*) key);
+}
+
+static CACHE_STAT_ENTRY*
+cache_stat_entry_new(const char* path, const struct stat* st, uint64_t content_hash)
+{
+    CACHE_STAT_ENTRY* entry;
+    size_t len = strlen(path);
+
+    entry = (CACHE_STAT_ENTRY*) malloc(sizeof(CACHE_STAT_ENTRY) + len);
+    CHECK(entry != NULL);
+    entry->mtime = (uint64_t) st->st_mtime;
+    entry->size = (uint64_t) st->st_size;
+    entry->ino = (uint64_t) st->st_ino;
+    entry->content_hash = content_hash;
+    entry->is_racy = 0;
+    memcpy(entry->path, path, len + 1);
+    return entry;
+}
+
+static void
+cache_load_stat_index(HTABLE* index, ARRAY* entries)
+{
+    char path[PATH_MAX];
+    char line[PATH_MAX + 128];
+    CACHE_STAT_ENTRY* entry;
+    unsigned long long mtime, size, ino, content_hash;
+    struct stat st;
+    int path_offset;
+    size_t len;
+    FILE* f;
+
+    snprintf(path, PATH_MAX, "%s/%s", cache_dir, CACHE_STAT_INDEX);
+    f = fopen(path, "r");
+    if(f == NULL)
+        return;
+
+    while(fgets(line, sizeof(line), f) != NULL) {
+        len = strlen(line);
+        if(len > 0  &&  line[len-1] == '\n')
+            line[--len] = '\0';
+
+        if(sscanf(line, "%llu %llu %llu %llx %n", &mtime, &size, &ino,
+                  &content_hash, &path_offset) != 4  ||  line[path_offset] == '\0')
+            continue;
+
+        st.st_mtime = (time_t) mtime;
+        st.st_size = (off_t) size;
+        st.st_ino = (ino_t) ino;
+        entry = cache_stat_entry_new(line + path_offset, &st, content_hash);
+        if(htable_lookup(index, cache_path_hash(entry->path),
+                         cache_stat_entry_cmp, entry->path) != NULL) {
+            free(entry);
+            continue;
+        }
+        CHECK(htable_insert(index, cache_path_hash(entry->path), entry) == 0);
+        CHECK(array_append(entries, entry) == 0);
+    }
+
+    fclose(f);
+}
+
+static void
+cache_write_stat_entry(FILE* f, const CACHE_STAT_ENTRY* entry)
+{
+    fprintf(f, "%llu %llu %llu %016llx %s\n", (unsigned long long) entry->mtime,
+            (unsigned long long) entry->size, (unsigned long long) entry->ino,
+            (unsigned long long) entry->content_hash, entry->path);
+}
+
+static void
+cache_save_stat_index(void)
+{
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    HTABLE new_paths = HTABLE_INITIALIZER;
+    HTABLE disk_index = HTABLE_INITIALIZER;
+    ARRAY disk_entries = ARRAY_INITIALIZER;
+    CACHE_STAT_ENTRY* entry;
+    size_t i;
+    FILE* f;
+
+    if(array_size(&cache_stat_new_entries) == 0)
+        return;
+
+    /* Other processes sharing the cache directory may have updated the index
+     * since we have loaded it. Re-read it so we do not throw their entries
+     * away. (If two processes race here, one of them still wins; but the
+     * index is just a hint, so the worst outcome is some extra hashing.) */
+    cache_load_stat_index(&disk_index, &disk_entries);
+
+    snprintf(path, PATH_MAX, "%s/%s", cache_dir, CACHE_STAT_INDEX);
+    f = path_create_temp(path, "w", tmp_path);
+    if(f == NULL) {
+        WARN("%s (%s)", strerror(errno), path);
+        htable_fini(&disk_index, NULL);
+        array_fini(&disk_entries, free);
+        return;
+    }
+
+    for(i = 0; i < array_size(&cache_stat_new_entries); i++) {
+        entry = (CACHE_STAT_ENTRY*) array_get(&cache_stat_new_entries, i);
+        if(!entry->is_racy)
+            cache_write_stat_entry(f, entry);
+        CHECK(htable_insert(&new_paths, cache_path_hash(entry->path), entry) == 0);
+    }
+    for(i = 0; i < array_size(&disk_entries); i++) {
+        entry = (CACHE_STAT_ENTRY*) array_get(&disk_entries, i);
+        if(htable_lookup(&new_paths, cache_path_hash(entry->path), cache_stat_entry_cmp, entry->path) == NULL)
+            cache_write_stat_entry(f, entry);
+    }
+    htable_fini(&new_paths, NULL);
+    htable_fini(&disk_index, NULL);
+    array_fini(&disk_entries, free);
+
+    if(fclose(f) != 0  ||  path_rename(tmp_path, path) != 0) {
+        WARN("%s (%s)", strerror(errno), path);
+        remove(tmp_path);
+    }
+}
+
+static void
+cache_load_last_run(void)
+{
+    char path[PATH_MAX];
+    unsigned long long cmdline_hash, tool_hash;
+    FILE* f;
+
+    snprintf(path, PATH_MAX, "%s/%s", cache_dir, CACHE_LAST_RUN);
+    f = fopen(path, "r");
+    if(f == NULL)
+        return;
+    if(fscanf(f, "%llx %llx", &tool_hash, &cmdline_hash) == 2) {
+        cache_last_tool_hash = (uint64_t) tool_hash;
+        cache_last_cmdline_hash = (uint64_t) cmdline_hash;
+        cache_has_last_run = 1;
+    }
+    fclose(f);
+}
+
+static void
+cache_save_last_run(void)
+{
+    char path[PATH_MAX];
+    FILE* f;
+
+    if(cache_has_last_run  &&  cache_last_tool_hash == cache_tool_hash  &&
+       cache_last_cmdline_hash == cache_cmdline_hash)
+        return;
+
+    snprintf(path, PATH_MAX, "%s/%s", cache_dir, CACHE_LAST_RUN);
+    f = fopen(path, "w");
+    if(f == NULL) {
+        WARN("%s (%s)", strerror(errno), path);
+        return;
+    }
+    fprintf(f, "%016llx %016llx\n", (unsigned long long) cache_tool_hash,
+            (unsigned long long) cache_cmdline_hash);
+    fclose(f);
+}
+
+static void
+cache_set_dir(const char* dir)
+{
+    if(strlen(dir) >= sizeof(cache_dir))
+        FATAL(_("Path too long (%s)."), dir);
+    strcpy(cache_dir, dir);
+}
+
+/* Append hit/miss counts of this run to the log. The line is short, so the
+ * append is effectively atomic even if more processes do it at once. */
+static void
+cache_log_stats(void)
+{
+    char path[PATH_MAX];
+    FILE* f;
+
+    if(cache_n_hits + cache_n_misses == 0)
+        return;
+
+    snprintf(path, PATH_MAX, "%s/%s", cache_dir, CACHE_STATS_LOG);
+    f = fopen(path, "a");
+    if(f == NULL) {
+        WARN("%s (%s)", strerror(errno), path);
+        return;
+    }
+    fprintf(f, "%u %u\n", cache_n_hits, cache_n_misses);
+    fclose(f);
+}
+
+void
+cache_prune(const char* dir, uint64_t size_limit)
+{
+    cache_dir_prune(dir, size_limit, 1);
+}
+
+void
+cache_print_stats(const char* dir)
+{
+    char path[PATH_MAX];
+    unsigned long long hits = 0, misses = 0;
+    unsigned n_entries;
+    uint64_t total_size;
+    unsigned run_hits, run_misses;
+    unsigned n_runs = 0;
+    FILE* f;
+
+    cache_set_dir(dir);
+    cache_dir_scan(cache_dir, &n_entries, &total_size);
+
+    snprintf(path, PATH_MAX, "%s/%s", cache_dir, CACHE_STATS_LOG);
+    f = fopen(path, "r");
+    if(f != NULL) {
+        while(fscanf(f, "%u %u", &run_hits, &run_misses) == 2) {
+            hits += run_hits;
+            misses += run_misses;
+            n_runs++;
+        }
+        fclose(f);
+    }
+
+    printf(_("Cache directory: %s\n"), cache_dir);
+    printf(_("Entries:         %u\n"), n_entries);
+    printf(_("Size:            %llu bytes\n"), (unsigned long long) total_size);
+    printf(_("Runs:            %u\n"), n_runs);
+    printf(_("Hits:            %llu\n"), hits);
+    printf(_("Misses:          %llu\n"), misses);
+    if(hits + misses > 0)
+        printf(_("Hit rate:        %.1f %%\n"), 100.0 * (double) hits / (double) (hits + misses));
+}
+
+static void cache_prefetch_worker(void* arg);
+
+void
+cache_init(const char* dir, const char* url, uint64_t options_hash, uint64_t size_limit)
+{
+    unsigned format_version = CACHE_FORMAT_VERSION;
+    int i;
+
+    if(dir != NULL) {
+        cache_set_dir(dir);
+        if(mkdir(cache_dir, 0755) != 0  &&  !path_is_dir(cache_dir))
+            FATAL("%s (%s)", strerror(errno), cache_dir);
+        cache_load_stat_index(&cache_stat_index, &cache_stat_old_entries);
+        cache_load_last_run();
+    }
+    cache_size_limit = size_limit;
+
+    if(url != NULL)
+        cache_backend = cache_http_backend_create(url);
+    else
+        cache_backend = cache_dir_backend_create(cache_dir);
+
+    /* The options already cover the libclang command line. Add everything
+     * else which may affect what we extract from the sources. */
+    cache_cmdline_hash = options_hash;
+    cache_options_hash = fnv1a_64(options_hash, PACKAGE_VERSION, strlen(PACKAGE_VERSION) + 1);
+    cache_options_hash = fnv1a_64(cache_options_hash, &format_version, sizeof(unsigned));
+    cache_tool_hash = fnv1a_64(FNV1A_BASE_64, PACKAGE_VERSION, strlen(PACKAGE_VERSION) + 1);
+    cache_tool_hash = fnv1a_64(cache_tool_hash, &format_version, sizeof(unsigned));
+
+    mutex_init(&cache_mutex);
+
+    if(cache_backend->is_remote) {
+        condvar_init(&cache_prefetch_has_work);
+        condvar_init(&cache_prefetch_has_done);
+        cache_prefetch_enabled = 1;
+        for(i = 0; i < CACHE_PREFETCH_THREADS; i++)
+            thread_create(&cache_prefetch_threads[i], cache_prefetch_worker, NULL);
+    }
+}
+
+static void
+cache_prefetch_free(void* item)
+{
+    buffer_fini(&((CACHE_PREFETCH*) item)->data);
+    free(item);
+}
+
+void
+cache_fini(void)
+{
+    int i;
+
+    if(cache_prefetch_enabled) {
+        mutex_lock(&cache_mutex);
+        cache_prefetch_closed = 1;
+        condvar_broadcast(&cache_prefetch_has_work);
+        mutex_unlock(&cache_mutex);
+        for(i = 0; i < CACHE_PREFETCH_THREADS; i++)
+            thread_join(&cache_prefetch_threads[i]);
+
+        htable_fini(&cache_prefetch_index, NULL);
+        array_fini(&cache_prefetch_queue, NULL);
+        array_fini(&cache_prefetch_items, cache_prefetch_free);
+        condvar_fini(&cache_prefetch_has_work);
+        condvar_fini(&cache_prefetch_has_done);
+    }
+
+    if(cache_dir[0] != '\0') {
+        cache_save_stat_index();
+        cache_save_last_run();
+        cache_log_stats();
+    }
+
+    NOTE(1, _("Cache: %u hits, %u misses."), cache_n_hits, cache_n_misses);
+
+    /* The cache can only grow if we have added something. */
+    if(!cache_backend->is_remote  &&  cache_size_limit > 0  &&  cache_n_saved > 0)
+        cache_dir_prune(cache_dir, cache_size_limit, 0);
+
+    cache_backend->destroy(cache_backend);
+    htable_fini(&cache_stat_index, NULL);
+    array_fini(&cache_stat_old_entries, free);
+    htable_fini(&cache_stat_new_index, NULL);
+    array_fini(&cache_stat_new_entries, free);
+    mutex_fini(&cache_mutex);
+}
+
+static int
+cache_hash_contents(const char* path, uint64_t* p_hash)
+{
+    char buffer[64 * 1024];
+    uint64_t hash = FNV1A_BASE_64;
+    size_t n;
+    FILE* f;
+
+    f = fopen(path, "rb");
+    if(f == NULL)
+        return -1;
+
+    while((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        hash = fnv1a_64(hash, buffer, n);
+
+    if(ferror(f)) {
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    *p_hash = hash;
+    return 0;
+}
+
+/* Get hash of the file contents. If `st` is NULL, we stat() the file
+ * ourselves. */
+static int
+cache_file_hash(const char* path, const struct stat* st, uint64_t* p_hash)
+{
+    struct stat st_buf;
+    CACHE_STAT_ENTRY* entry;
+    CACHE_STAT_ENTRY* other;
+    uint64_t content_hash;
+    uint64_t path_hash = cache_path_hash(path);
+
+    /* Maybe we have already hashed it during this run. */
+    mutex_lock(&cache_mutex);
+    entry = (CACHE_STAT_ENTRY*) htable_lookup(&cache_stat_new_index,
+                    path_hash, cache_stat_entry_cmp, path);
+    mutex_unlock(&cache_mutex);
+    if(entry != NULL) {
+        *p_hash = entry->content_hash;
+        return 0;
+    }
+
+    if(st == NULL) {
+        if(stat(path, &st_buf) != 0)
+            return -1;
+        st = &st_buf;
+    }
+
+    entry = (CACHE_STAT_ENTRY*) htable_lookup(&cache_stat_index,
+                    path_hash, cache_stat_entry_cmp, path);
+    if(entry != NULL  &&  entry->mtime == (uint64_t) st->st_mtime  &&
+       entry->size == (uint64_t) st->st_size  &&  entry->ino == (uint64_t) st->st_ino)
+    {
+        *p_hash = entry->content_hash;
+        return 0;
+    }
+
+    if(cache_hash_contents(path, &content_hash) != 0)
+        return -1;
+
+    entry = cache_stat_entry_new(path, st, content_hash);
+    /* If the file has been modified just now, it may get modified again
+     * within the same second without any change of the stat info. Do not
+     * trust the stat info of such "racily clean" files next time. */
+    if((time_t) st->st_mtime >= time(NULL) - 1)
+        entry->is_racy = 1;
+
+    mutex_lock(&cache_mutex);
+    other = (CACHE_STAT_ENTRY*) htable_lookup(&cache_stat_new_index,
+                    path_hash, cache_stat_entry_cmp, path);
+    if(other == NULL) {
+        CHECK(htable_insert(&cache_stat_new_index, path_hash, entry) == 0);
+        CHECK(array_append(&cache_stat_new_entries, entry) == 0);
+    } else {
+        /* Another thread has been faster. */
+        free(entry);
+        entry = other;
+    }
+    mutex_unlock(&cache_mutex);
+
+    *p_hash = entry->content_hash;
+    return 0;
+}
+
+/* Compute the key of the cache entry for the file. */
+static int
+cache_entry_key(const char* path, const struct stat* st, uint64_t* p_content_hash, uint64_t* p_key)
+{
+    uint64_t key;
+
+    if(cache_file_hash(path, st, p_content_hash) != 0)
+        return -1;
+
+    /* The path is part of the key as the parser results refer to it. */
+    key = fnv1a_64(cache_options_hash, path, strlen(path) + 1);
+    key = fnv1a_64(key, p_content_hash, sizeof(uint64_t));
+    *p_key = key;
+    return 0;
+}
+
+static void
+cache_prefetch_worker(void* arg)
+{
+    CACHE_PREFETCH* batch[CACHE_PREFETCH_BATCH];
+    uint64_t keys[CACHE_PREFETCH_BATCH];
+    int exists[CACHE_PREFETCH_BATCH];
+    int has_key[CACHE_PREFETCH_BATCH];
+    uint64_t content_hash;
+    size_t i, n;
+
+    while(1) {
+        /* Take as many queued items as we can, so we can check for their
+         * existence in one go. */
+        mutex_lock(&cache_mutex);
+        while(cache_prefetch_queue_head >= array_size(&cache_prefetch_queue)  &&  !cache_prefetch_closed)
+            condvar_wait(&cache_prefetch_has_work, &cache_mutex);
+        n = 0;
+        while(n < CACHE_PREFETCH_BATCH  &&  cache_prefetch_queue_head < array_size(&cache_prefetch_queue))
+            batch[n++] = (CACHE_PREFETCH*) array_get(&cache_prefetch_queue, cache_prefetch_queue_head++);
+        if(cache_prefetch_queue_head >= array_size(&cache_prefetch_queue)) {
+            array_clear(&cache_prefetch_queue, NULL);
+            cache_prefetch_queue_head = 0;
+        }
+        mutex_unlock(&cache_mutex);
+
+        if(n == 0)
+            break;      /* Closed and nothing left. */
+
+        for(i = 0; i < n; i++) {
+            has_key[i] = (cache_entry_key(batch[i]->path, &batch[i]->st, &content_hash, &keys[i]) == 0);
+            exists[i] = 1;
+        }
+
+        /* Fetch only the entries which exist. (If the check fails, just try
+         * to fetch all of them.) */
+        if(cache_backend->exists(cache_backend, keys, n, exists) != 0) {
+            for(i = 0; i < n; i++)
+                exists[i] = 1;
+        }
+
+        for(i = 0; i < n; i++) {
+            if(!has_key[i])
+                batch[i]->result = CACHE_BACKEND_ERROR;
+            else if(!exists[i])
+                batch[i]->result = CACHE_BACKEND_NOT_FOUND;
+            else
+                batch[i]->result = cache_backend->get(cache_backend, keys[i], &batch[i]->data);
+        }
+
+        mutex_lock(&cache_mutex);
+        for(i = 0; i < n; i++)
+            batch[i]->is_done = 1;
+        condvar_broadcast(&cache_prefetch_has_done);
+        mutex_unlock(&cache_mutex);
+    }
+}
+
+void
+cache_prefetch(const char* path, const struct stat* st)
+{
+    CACHE_PREFETCH* item;
+    size_t len;
+
+    if(!cache_prefetch_enabled)
+        return;
+
+    len = strlen(path);
+    item = (CACHE_PREFETCH*) malloc(sizeof(CACHE_PREFETCH) + len);
+    CHECK(item != NULL);
+    memcpy(&item->st, st, sizeof(struct stat));
+    item->is_done = 0;
+    item->result = CACHE_BACKEND_ERROR;
+    buffer_init(&item->data);
+    memcpy(item->path, path, len + 1);
+
+    mutex_lock(&cache_mutex);
+    CHECK(array_append(&cache_prefetch_items, item) == 0);
+    CHECK(array_append(&cache_prefetch_queue, item) == 0);
+    CHECK(htable_insert(&cache_prefetch_index, cache_path_hash(path), item) == 0);
+    condvar_signal(&cache_prefetch_has_work);
+    mutex_unlock(&cache_mutex);
+}
+
+static int
+cache_prefetch_cmp(const void* item, const void* key)
+{
+    return strcmp(((const CACHE_PREFETCH*) item)->path, (const char*) key);
+}
+
+/* Get the entry, either from the prefetched data or from the backend. */
+static int
+cache_get_entry(const char* path, uint64_t key, BUFFER* data)
+{
+    CACHE_PREFETCH* item = NULL;
+    int result = CACHE_BACKEND_ERROR;
+
+    if(cache_prefetch_enabled) {
+        mutex_lock(&cache_mutex);
+        item = (CACHE_PREFETCH*) htable_lookup(&cache_prefetch_index,
+                        cache_path_hash(path), cache_prefetch_cmp, path);
+        if(item != NULL) {
+            while(!item->is_done)
+                condvar_wait(&cache_prefetch_has_done, &cache_mutex);
+            result = item->result;
+            /* Steal the data. */
+            memcpy(data, &item->data, sizeof(BUFFER));
+            buffer_init(&item->data);
+        }
+        mutex_unlock(&cache_mutex);
+    }
+
+    if(result == CACHE_BACKEND_ERROR) {
+        buffer_clear(data);
+        result = cache_backend->get(cache_backend, key, data);
+    }
+    return result;
+}
+
+static int
+cache_check_dep(const VALUE* key, VALUE* value, void* ctx)
+{
+    CACHE_EXPLAIN* explain = (CACHE_EXPLAIN*) ctx;
+    const char* dep = value_string(key);
+    unsigned long long expected_hash;
+    uint64_t hash;
+
+    if(value_string(value) == NULL  ||  sscanf(value_string(value), "%llx", &expected_hash) != 1) {
+        explain->changed = CACHE_CHANGED_ENTRY;
+        snprintf(explain->reason, sizeof(explain->reason), "%s", _("cache entry is malformed"));
+        return -1;
+    }
+
+    if(cache_file_hash(dep, NULL, &hash) != 0) {
+        explain->changed = CACHE_CHANGED_INCLUDE;
+        snprintf(explain->reason, sizeof(explain->reason), _("included file %s has disappeared"), dep);
+        return -1;
+    }
+
+    if(hash != (uint64_t) expected_hash) {
+        explain->changed = CACHE_CHANGED_INCLUDE;
+        snprintf(explain->reason, sizeof(explain->reason), _("included file %s has changed"), dep);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+cache_lookup(const char* path, const struct stat* st, STORE* part, CACHE_EXPLAIN* explain)
+{
+    BUFFER data = BUFFER_INITIALIZER;
+    CACHE_STAT_ENTRY* old_entry;
+    VALUE root;
+    VALUE* deps;
+    VALUE* store;
+    int ret = CACHE_MISS;
+
+    explain->options_hash = cache_cmdline_hash;
+    explain->tool_hash = cache_tool_hash;
+    explain->changed = NULL;
+    explain->reason[0] = '\0';
+
+    if(cache_entry_key(path, st, &explain->content_hash, &explain->key) != 0) {
+        explain->changed = CACHE_CHANGED_CONTENT;
+        snprintf(explain->reason, sizeof(explain->reason), "%s", strerror(errno));
+        return CACHE_FAIL;
+    }
+
+    switch(cache_get_entry(path, explain->key, &data)) {
+        case CACHE_BACKEND_FOUND:
+            break;
+
+        case CACHE_BACKEND_NOT_FOUND:
+            /* Try to guess why the entry is not there. */
+            old_entry = (CACHE_STAT_ENTRY*) htable_lookup(&cache_stat_index,
+                            cache_path_hash(path), cache_stat_entry_cmp, path);
+            if(old_entry == NULL) {
+                explain->changed = CACHE_CHANGED_NEW;
+                snprintf(explain->reason, sizeof(explain->reason), "%s", _("not cached yet"));
+            } else if(old_entry->content_hash != explain->content_hash) {
+                explain->changed = CACHE_CHANGED_CONTENT;
+                snprintf(explain->reason, sizeof(explain->reason), "%s", _("file contents have changed"));
+            } else if(!cache_has_last_run) {
+                explain->changed = CACHE_CHANGED_UNKNOWN;
+                snprintf(explain->reason, sizeof(explain->reason), "%s", _("options or DocBaker version have changed"));
+            } else if(cache_last_tool_hash != cache_tool_hash) {
+                explain->changed = CACHE_CHANGED_TOOL;
+                snprintf(explain->reason, sizeof(explain->reason), "%s", _("DocBaker version has changed"));
+            } else if(cache_last_cmdline_hash != cache_cmdline_hash) {
+                explain->changed = CACHE_CHANGED_OPTIONS;
+                snprintf(explain->reason, sizeof(explain->reason), "%s", _("options have changed"));
+            } else {
+                explain->changed = CACHE_CHANGED_NONE;
+                snprintf(explain->reason, sizeof(explain->reason), "%s", _("cache entry has been evicted"));
+            }
+            goto out;
+
+        default:
+            explain->changed = CACHE_CHANGED_CACHE;
+            snprintf(explain->reason, sizeof(explain->reason), "%s", _("cache is not accessible"));
+            goto out;
+    }
+
+    if(store_parse_json((const char*) buffer_data(&data), buffer_size(&data), path, &root) != 0) {
+        explain->changed = CACHE_CHANGED_ENTRY;
+        snprintf(explain->reason, sizeof(explain->reason), "%s", _("cache entry is unreadable"));
+        goto out;
+    }
+
+    deps = value_dict_get(&root, "deps");
+    store = value_dict_get(&root, "store");
+    if(value_type(deps) != VALUE_DICT  ||  value_type(store) != VALUE_DICT) {
+        explain->changed = CACHE_CHANGED_ENTRY;
+        snprintf(explain->reason, sizeof(explain->reason), "%s", _("cache entry is malformed"));
+        value_fini(&root);
+        goto out;
+    }
+
+    /* The key covers only the file itself. Check the included files
+     * have not changed since. */
+    if(value_dict_walk_sorted(deps, cache_check_dep, explain) != 0) {
+        value_fini(&root);
+        goto out;
+    }
+
+    if(store_import(part, store, path) != 0) {
+        explain->changed = CACHE_CHANGED_ENTRY;
+        snprintf(explain->reason, sizeof(explain->reason), "%s", _("cache entry is malformed"));
+        value_fini(&root);
+        goto out;
+    }
+    value_fini(&root);
+    ret = CACHE_HIT;
+
+out:
+    buffer_fini(&data);
+
+    mutex_lock(&cache_mutex);
+    if(ret == CACHE_HIT)
+        cache_n_hits++;
+    else
+        cache_n_misses++;
+    mutex_unlock(&cache_mutex);
+
+    return ret;
+}
+
+static int
+cache_write_callback(const char* data, size_t size, void* userdata)
+{
+    return buffer_append((BUFFER*) userdata, data, size);
+}
+
+void
+cache_save(uint64_t key, const STORE* part, const ARRAY* deps)
+{
+    BUFFER data = BUFFER_INITIALIZER;
+    char buffer[32];
+    VALUE deps_dict;
+    VALUE store;
+    uint64_t hash;
+    const char* dep;
+    size_t i;
+    int err;
+
+    /* Remember hashes of all the included files so cache_lookup() can
+     * detect the entry has gone stale because of them. */
+    value_init_dict(&deps_dict);
+    for(i = 0; i < array_size(deps); i++) {
+        dep = (const char*) array_get(deps, i);
+        if(cache_file_hash(dep, NULL, &hash) != 0) {
+            /* We would never be able to validate the entry. */
+            value_fini(&deps_dict);
+            return;
+        }
+        snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) hash);
+        CHECK(value_init_string(value_dict_get_or_add(&deps_dict, dep), buffer) == 0);
+    }
+
+    store_export(part, &store);
+
+    /* Write {"deps":{...},"store":{...}} without building the wrapping object,
+     * so we do not have to copy the (possibly big) store. */
+    err = cache_write_callback("{\"deps\":", 8, &data);
+    if(err == 0)
+        err = json_dom_dump(&deps_dict, cache_write_callback, &data, 0, JSON_DOM_DUMP_MINIMIZE);
+    if(err == 0)
+        err = cache_write_callback(",\"store\":", 9, &data);
+    if(err == 0)
+        err = json_dom_dump(&store, cache_write_callback, &data, 0, JSON_DOM_DUMP_MINIMIZE);
+    if(err == 0)
+        err = cache_write_callback("}", 1, &data);
+    value_fini(&deps_dict);
+    value_fini(&store);
+    CHECK(err == 0);
+
+    if(cache_backend->put(cache_backend, key, buffer_data(&data), buffer_size(&data)) == 0) {
+        mutex_lock(&cache_mutex);
+        cache_n_saved++;
+        mutex_unlock(&cache_mutex);
+    }
+
+    buffer_fini(&data);
+}
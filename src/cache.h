@@ -0,0 +1,117 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_CACHE_H
+#define DOCBAKER_CACHE_H
+
+#include "misc.h"
+#include "array.h"
+#include "store.h"
+
+
+/* Persistent cache of per-file parser results.
+ *
+ * For each parsed input file, the cache remembers the partial store the
+ * parser has produced for it. The entry is keyed by a hash of the file path,
+ * its contents, the effective libclang options and the DocBaker version, so
+ * whenever any of those changes, the entry is simply not found anymore.
+ *
+ * Each entry also records hashes of all the files included by the file, so
+ * the entry is not used if any of the headers has changed.
+ *
+ * To avoid reading and hashing all the files on every run, the cache also
+ * keeps a stat index: For each path, it remembers (mtime, size, inode) and
+ * the hash of the contents. If the stat info still matches, the stored hash
+ * is reused.
+ *
+ * More processes may share the cache directory: Entries are written into a
+ * temporary file and atomically renamed, so readers see either a complete
+ * entry or none.
+ *
+ * All the functions except cache_init() and cache_fini() may be called from
+ * any thread.
+ */
+
+/* The entries are stored in the local `cache_dir` or, if `url` is not NULL,
+ * on the HTTP server (see cache_backend.h). The local directory (if any)
+ * also keeps the stat index and statistics.
+ *
+ * If size_limit is not zero, the least recently used entries are removed
+ * from the local directory in cache_fini() whenever the cache grows above
+ * the limit. */
+void cache_init(const char* cache_dir, const char* url, uint64_t options_hash, uint64_t size_limit);
+void cache_fini(void);
+
+/* Announce the file will be looked up soon. For a remote cache, its entry
+ * is then fetched in the background. */
+void cache_prefetch(const char* path, const struct stat* st);
+
+/* Return values of cache_lookup(). */
+#define CACHE_HIT           0
+#define CACHE_MISS          1
+#define CACHE_FAIL          (-1)
+
+/* Which of the key components has changed, causing a cache miss. */
+#define CACHE_CHANGED_NEW       "new"       /* Never cached before. */
+#define CACHE_CHANGED_CONTENT   "content"   /* Contents of the file itself. */
+#define CACHE_CHANGED_INCLUDE   "include"   /* An included file. */
+#define CACHE_CHANGED_OPTIONS   "options"   /* The libclang command line. */
+#define CACHE_CHANGED_TOOL      "tool"      /* DocBaker version. */
+#define CACHE_CHANGED_NONE      "none"      /* Nothing; entry has been evicted. */
+#define CACHE_CHANGED_UNKNOWN   "unknown"   /* Options or DocBaker version. */
+#define CACHE_CHANGED_ENTRY     "entry"     /* The entry is broken. */
+#define CACHE_CHANGED_CACHE     "cache"     /* The cache is not accessible. */
+
+/* Details of the lookup, for --explain. */
+typedef struct CACHE_EXPLAIN {
+    uint64_t key;
+    uint64_t content_hash;
+    uint64_t options_hash;
+    uint64_t tool_hash;
+    const char* changed;        /* CACHE_CHANGED_xxxx, or NULL on a hit. */
+    char reason[PATH_MAX + 64]; /* Human readable description. */
+} CACHE_EXPLAIN;
+
+/* Look the file up in the cache. On a hit, add the cached partial store
+ * into `part` and return CACHE_HIT.
+ *
+ * Otherwise describe the reason in `explain` and return CACHE_MISS. In that
+ * case `explain->key` is set and it may be used for cache_save() after the
+ * file is parsed. CACHE_FAIL means the file cannot be even read.
+ */
+int cache_lookup(const char* path, const struct stat* st, STORE* part, CACHE_EXPLAIN* explain);
+
+/* Save the partial store into the cache. `deps` is the list of files
+ * included by the file (as gathered by parse_cxx()). */
+void cache_save(uint64_t key, const STORE* part, const ARRAY* deps);
+
+
+/* Helpers of the "cache" command. These are used instead of (not together
+ * with) cache_init() and cache_fini(). */
+void cache_print_stats(const char* cache_dir);
+void cache_prune(const char* cache_dir, uint64_t size_limit);
+
+
+#endif  /* DOCBAKER_CACHE_H */
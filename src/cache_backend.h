@@ -0,0 +1,82 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_CACHE_BACKEND_H
+#define DOCBAKER_CACHE_BACKEND_H
+
+#include "misc.h"
+#include "buffer.h"
+
+
+/* Storage of the cache entries (see cache.h).
+ *
+ * For the backend, an entry is just an opaque blob identified by a 64-bit key
+ * (the hash of everything the entry depends on). All the functions have to
+ * be safe to call from more threads at once.
+ */
+
+#define CACHE_BACKEND_FOUND         0
+#define CACHE_BACKEND_NOT_FOUND     1
+#define CACHE_BACKEND_ERROR         (-1)
+
+typedef struct CACHE_BACKEND CACHE_BACKEND;
+struct CACHE_BACKEND {
+    /* Non-zero if each request is expensive (e.g. a network round-trip), so
+     * it pays off to prefetch the entries. */
+    int is_remote;
+
+    /* Append the entry into `data`. Returns CACHE_BACKEND_FOUND,
+     * CACHE_BACKEND_NOT_FOUND or CACHE_BACKEND_ERROR. */
+    int (*get)(CACHE_BACKEND* backend, uint64_t key, BUFFER* data);
+
+    /* Store the entry. Returns zero on success, -1 on failure. */
+    int (*put)(CACHE_BACKEND* backend, uint64_t key, const void* data, size_t size);
+
+    /* Check existence of n entries at once. Sets exists[i] to non-zero if
+     * the entry keys[i] exists. Returns zero on success, -1 on failure. */
+    int (*exists)(CACHE_BACKEND* backend, const uint64_t* keys, size_t n, int* exists);
+
+    void (*destroy)(CACHE_BACKEND* backend);
+};
+
+
+/* Entries stored in a local directory. */
+CACHE_BACKEND* cache_dir_backend_create(const char* dir);
+
+/* Scan the local directory. Returns count and total size of the entries. */
+void cache_dir_scan(const char* dir, unsigned* p_n_entries, uint64_t* p_size);
+
+/* Remove the least recently used entries from the local directory until
+ * the cache fits into the size limit. */
+void cache_dir_prune(const char* dir, uint64_t size_limit, int verbose);
+
+
+/* Entries stored on an HTTP server at the given URL ("http://host[:port]/
+ * [path]"). The server just has to support GET, HEAD and PUT of static
+ * files. */
+CACHE_BACKEND* cache_http_backend_create(const char* url);
+
+
+#endif  /* DOCBAKER_CACHE_BACKEND_H */
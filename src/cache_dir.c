@@ -0,0 +1,315 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "cache_backend.h"
+#include "array.h"
+#include "path_util.h"
+
+#include <time.h>
+
+#ifdef _WIN32
+    #include <sys/utime.h>
+#else
+    #include <utime.h>
+#endif
+
+
+/* When pruning, go somewhat below the limit so we do not have to prune
+ * again on the very next run. */
+#define CACHE_PRUNE_TARGET(limit)   ((limit) / 10 * 9)
+
+/* Temporary files older than this are leftovers of crashed processes. */
+#define CACHE_STALE_TMP_AGE         (60 * 60)
+
+
+typedef struct CACHE_DIR_BACKEND {
+    CACHE_BACKEND base;
+    /* (Leave some space for names of the files in the directory.) */
+    char dir[PATH_MAX - 64];
+} CACHE_DIR_BACKEND;
+
+
+static void
+cache_dir_entry_path(CACHE_DIR_BACKEND* backend, uint64_t key, char buffer[PATH_MAX])
+{
+    /* Use the first byte of the key as a subdirectory, so we do not end up
+     * with too many files in a single directory. */
+    snprintf(buffer, PATH_MAX, "%s/%02x/%014llx.json", backend->dir,
+             (unsigned) (key >> 56), (unsigned long long) (key & 0x00ffffffffffffffULL));
+}
+
+static void
+cache_dir_touch(const char* path, const struct stat* st)
+{
+    struct utimbuf times;
+
+    /* Do not rely on the file system to maintain the access time (it is
+     * often mounted with noatime or relatime). Pruning needs it. */
+    times.actime = time(NULL);
+    times.modtime = st->st_mtime;
+    utime(path, &times);
+}
+
+static int
+cache_dir_get(CACHE_BACKEND* b, uint64_t key, BUFFER* data)
+{
+    CACHE_DIR_BACKEND* backend = (CACHE_DIR_BACKEND*) b;
+    char path[PATH_MAX];
+    struct stat st;
+    size_t n;
+    FILE* f;
+
+    cache_dir_entry_path(backend, key, path);
+    f = fopen(path, "rb");
+    if(f == NULL)
+        return (errno == ENOENT ? CACHE_BACKEND_NOT_FOUND : CACHE_BACKEND_ERROR);
+
+    if(fstat(fileno(f), &st) != 0  ||  buffer_reserve(data, (size_t) st.st_size) != 0) {
+        fclose(f);
+        return CACHE_BACKEND_ERROR;
+    }
+    n = fread(buffer_data_at(data, buffer_size(data)), 1, (size_t) st.st_size, f);
+    fclose(f);
+    if(n != (size_t) st.st_size)
+        return CACHE_BACKEND_ERROR;
+    data->size += n;
+
+    cache_dir_touch(path, &st);
+    return CACHE_BACKEND_FOUND;
+}
+
+static int
+cache_dir_put(CACHE_BACKEND* b, uint64_t key, const void* data, size_t size)
+{
+    CACHE_DIR_BACKEND* backend = (CACHE_DIR_BACKEND*) b;
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    FILE* f;
+    int err = 0;
+
+    cache_dir_entry_path(backend, key, path);
+
+    /* Make sure the subdirectory exists. */
+    *(char*) path_basename(path) = '\0';
+    if(mkdir(path, 0755) != 0  &&  !path_is_dir(path)) {
+        WARN("%s (%s)", strerror(errno), path);
+        return -1;
+    }
+    cache_dir_entry_path(backend, key, path);
+
+    /* Write into a temporary file and rename it only when complete, so no
+     * reader can ever see a partially written entry. */
+    f = path_create_temp(path, "wb", tmp_path);
+    if(f == NULL) {
+        WARN("%s (%s)", strerror(errno), path);
+        return -1;
+    }
+    if(fwrite(data, 1, size, f) != size)
+        err = -1;
+    if(fclose(f) != 0)
+        err = -1;
+
+    if(err != 0  ||  path_rename(tmp_path, path) != 0) {
+        WARN(_("Failed to write cache entry %s."), path);
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+cache_dir_exists(CACHE_BACKEND* b, const uint64_t* keys, size_t n, int* exists)
+{
+    CACHE_DIR_BACKEND* backend = (CACHE_DIR_BACKEND*) b;
+    char path[PATH_MAX];
+    struct stat st;
+    size_t i;
+
+    for(i = 0; i < n; i++) {
+        cache_dir_entry_path(backend, keys[i], path);
+        exists[i] = (stat(path, &st) == 0);
+    }
+
+    return 0;
+}
+
+static void
+cache_dir_destroy(CACHE_BACKEND* b)
+{
+    free(b);
+}
+
+CACHE_BACKEND*
+cache_dir_backend_create(const char* dir)
+{
+    CACHE_DIR_BACKEND* backend;
+
+    if(strlen(dir) >= sizeof(backend->dir))
+        FATAL(_("Path too long (%s)."), dir);
+
+    backend = (CACHE_DIR_BACKEND*) malloc(sizeof(CACHE_DIR_BACKEND));
+    CHECK(backend != NULL);
+    backend->base.is_remote = 0;
+    backend->base.get = cache_dir_get;
+    backend->base.put = cache_dir_put;
+    backend->base.exists = cache_dir_exists;
+    backend->base.destroy = cache_dir_destroy;
+    strcpy(backend->dir, dir);
+    return &backend->base;
+}
+
+
+typedef struct CACHE_FILE_INFO {
+    uint64_t atime;
+    uint64_t size;
+    char path[1];
+} CACHE_FILE_INFO;
+
+static int
+cache_file_info_cmp(const void* a, const void* b)
+{
+    const CACHE_FILE_INFO* info_a = *(const CACHE_FILE_INFO**) a;
+    const CACHE_FILE_INFO* info_b = *(const CACHE_FILE_INFO**) b;
+
+    if(info_a->atime != info_b->atime)
+        return (info_a->atime < info_b->atime) ? -1 : +1;
+    return strcmp(info_a->path, info_b->path);
+}
+
+static int
+cache_has_suffix(const char* str, const char* suffix)
+{
+    size_t len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return (len >= suffix_len  &&  strcmp(str + len - suffix_len, suffix) == 0);
+}
+
+/* Collect all entries in the cache directory. Leftover temporary files are
+ * removed on the fly. Returns total size of the entries. */
+static uint64_t
+cache_dir_scan_entries(const char* dir, ARRAY* entries)
+{
+    char subdir[PATH_MAX];
+    char name[PATH_MAX];
+    char path[2 * PATH_MAX];
+    CACHE_FILE_INFO* info;
+    PATH_DIR* d;
+    PATH_DIR* sd;
+    struct stat st;
+    uint64_t total_size = 0;
+    time_t now = time(NULL);
+
+    d = path_opendir(dir);
+    if(d == NULL)
+        FATAL("%s (%s)", strerror(errno), dir);
+
+    while(path_readdir(d, name) == 0) {
+        /* Entries live only in the two-digit subdirectories. */
+        if(strlen(name) != 2  ||  name[0] == '.')
+            continue;
+        snprintf(subdir, PATH_MAX, "%s/%.2s", dir, name);
+        sd = path_opendir(subdir);
+        if(sd == NULL)
+            continue;
+
+        while(path_readdir(sd, name) == 0) {
+            snprintf(path, sizeof(path), "%s/%s", subdir, name);
+            if(stat(path, &st) != 0  ||  S_ISDIR(st.st_mode))
+                continue;
+
+            if(strstr(name, ".tmp.") != NULL  ||  cache_has_suffix(name, ".tmp")) {
+                /* Do not touch temporary files of a process which is just
+                 * writing them. (The ".tmp" suffix is what older versions
+                 * left behind.) */
+                if(st.st_mtime < now - CACHE_STALE_TMP_AGE)
+                    remove(path);
+                continue;
+            }
+            if(!cache_has_suffix(name, ".json"))
+                continue;
+
+            info = (CACHE_FILE_INFO*) malloc(sizeof(CACHE_FILE_INFO) + strlen(path));
+            CHECK(info != NULL);
+            info->atime = (uint64_t) st.st_atime;
+            info->size = (uint64_t) st.st_size;
+            strcpy(info->path, path);
+            CHECK(array_append(entries, info) == 0);
+            total_size += info->size;
+        }
+
+        path_closedir(sd);
+    }
+
+    path_closedir(d);
+    return total_size;
+}
+
+void
+cache_dir_scan(const char* dir, unsigned* p_n_entries, uint64_t* p_size)
+{
+    ARRAY entries = ARRAY_INITIALIZER;
+
+    *p_size = cache_dir_scan_entries(dir, &entries);
+    *p_n_entries = (unsigned) array_size(&entries);
+    array_fini(&entries, free);
+}
+
+/* Note another process may be reading any of the entries while we remove
+ * it. That is fine: On POSIX, it can finish reading it; on Windows, the
+ * removal fails and we just do not count it. */
+void
+cache_dir_prune(const char* dir, uint64_t size_limit, int verbose)
+{
+    ARRAY entries = ARRAY_INITIALIZER;
+    CACHE_FILE_INFO* info;
+    uint64_t total_size;
+    uint64_t removed_size = 0;
+    unsigned n_removed = 0;
+    size_t i;
+
+    total_size = cache_dir_scan_entries(dir, &entries);
+    if(total_size > size_limit) {
+        qsort(array_data(&entries), array_size(&entries), sizeof(void*), cache_file_info_cmp);
+        for(i = 0; i < array_size(&entries); i++) {
+            if(total_size - removed_size <= CACHE_PRUNE_TARGET(size_limit))
+                break;
+            info = (CACHE_FILE_INFO*) array_get(&entries, i);
+            if(remove(info->path) == 0) {
+                removed_size += info->size;
+                n_removed++;
+            }
+        }
+    }
+
+    if(verbose || n_removed > 0) {
+        NOTE((verbose ? 0 : 1), _("Cache: Removed %u entries (%llu bytes), %llu bytes remain."),
+             n_removed, (unsigned long long) removed_size,
+             (unsigned long long) (total_size - removed_size));
+    }
+
+    array_fini(&entries, free);
+}
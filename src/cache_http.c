@@ -0,0 +1,460 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "cache_backend.h"
+
+#include <ctype.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    typedef SOCKET HTTP_SOCKET;
+    #define HTTP_INVALID_SOCKET         INVALID_SOCKET
+    #define http_close_socket(s)        closesocket(s)
+#else
+    #include <netdb.h>
+    #include <sys/socket.h>
+    #include <sys/time.h>
+    typedef int HTTP_SOCKET;
+    #define HTTP_INVALID_SOCKET         (-1)
+    #define http_close_socket(s)        close(s)
+#endif
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL                0
+#endif
+
+
+/* Give up if the server does not respond for this long (in seconds). */
+#define HTTP_TIMEOUT                30
+
+/* How many HEAD requests we pipeline over a single connection. */
+#define HTTP_EXISTS_BATCH           64
+
+
+typedef struct CACHE_HTTP_BACKEND {
+    CACHE_BACKEND base;
+    char host[256];
+    char port[16];
+    char prefix[PATH_MAX - 64];     /* URL path, without the trailing '/'. */
+    int has_warned;
+} CACHE_HTTP_BACKEND;
+
+typedef struct HTTP_CONN {
+    HTTP_SOCKET sock;
+    size_t pos;
+    size_t len;
+    char buffer[16 * 1024];
+} HTTP_CONN;
+
+
+static void
+http_warn(CACHE_HTTP_BACKEND* backend, const char* what)
+{
+    /* Do not flood the output if the server is down: Every request would
+     * fail the same way. (The race on the flag is harmless.) */
+    if(!backend->has_warned) {
+        backend->has_warned = 1;
+        WARN(_("Remote cache http://%s:%s%s: %s (further errors are not reported)."),
+             backend->host, backend->port, backend->prefix, what);
+    }
+}
+
+static int
+http_connect(CACHE_HTTP_BACKEND* backend, HTTP_CONN* conn)
+{
+    struct addrinfo hints;
+    struct addrinfo* addrs;
+    struct addrinfo* addr;
+#ifdef _WIN32
+    DWORD timeout = HTTP_TIMEOUT * 1000;
+#else
+    struct timeval timeout = { HTTP_TIMEOUT, 0 };
+#endif
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(backend->host, backend->port, &hints, &addrs) != 0) {
+        http_warn(backend, _("Cannot resolve the host"));
+        return -1;
+    }
+
+    conn->sock = HTTP_INVALID_SOCKET;
+    conn->pos = 0;
+    conn->len = 0;
+    for(addr = addrs; addr != NULL; addr = addr->ai_next) {
+        conn->sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if(conn->sock == HTTP_INVALID_SOCKET)
+            continue;
+        if(connect(conn->sock, addr->ai_addr, (int) addr->ai_addrlen) == 0)
+            break;
+        http_close_socket(conn->sock);
+        conn->sock = HTTP_INVALID_SOCKET;
+    }
+    freeaddrinfo(addrs);
+
+    if(conn->sock == HTTP_INVALID_SOCKET) {
+        http_warn(backend, _("Cannot connect"));
+        return -1;
+    }
+
+    setsockopt(conn->sock, SOL_SOCKET, SO_RCVTIMEO, (const char*) &timeout, sizeof(timeout));
+    setsockopt(conn->sock, SOL_SOCKET, SO_SNDTIMEO, (const char*) &timeout, sizeof(timeout));
+    return 0;
+}
+
+static void
+http_disconnect(HTTP_CONN* conn)
+{
+    http_close_socket(conn->sock);
+}
+
+static int
+http_send(HTTP_CONN* conn, const void* data, size_t size)
+{
+    const char* ptr = (const char*) data;
+    int n;
+
+    while(size > 0) {
+        n = send(conn->sock, ptr, (int) (size < 64 * 1024 ? size : 64 * 1024), MSG_NOSIGNAL);
+        if(n <= 0)
+            return -1;
+        ptr += n;
+        size -= (size_t) n;
+    }
+
+    return 0;
+}
+
+/* Make sure there is something in the receive buffer. Returns -1 on error
+ * or EOF. */
+static int
+http_fill(HTTP_CONN* conn)
+{
+    int n;
+
+    if(conn->pos < conn->len)
+        return 0;
+
+    n = recv(conn->sock, conn->buffer, sizeof(conn->buffer), 0);
+    if(n <= 0)
+        return -1;
+    conn->pos = 0;
+    conn->len = (size_t) n;
+    return 0;
+}
+
+static int
+http_read_line(HTTP_CONN* conn, char* line, size_t line_size)
+{
+    size_t len = 0;
+    char ch;
+
+    while(1) {
+        if(http_fill(conn) != 0)
+            return -1;
+        ch = conn->buffer[conn->pos++];
+        if(ch == '\n')
+            break;
+        if(len + 1 < line_size)
+            line[len++] = ch;
+    }
+
+    if(len > 0  &&  line[len-1] == '\r')
+        len--;
+    line[len] = '\0';
+    return 0;
+}
+
+static int
+http_header_is(const char* line, const char* name)
+{
+    size_t i;
+
+    for(i = 0; name[i] != '\0'; i++) {
+        if(line[i] == '\0'  ||  tolower((unsigned char) line[i]) != tolower((unsigned char) name[i]))
+            return 0;
+    }
+    return (line[i] == ':');
+}
+
+/* Read status line and headers of the response. Sets *p_content_length to
+ * -1 if there is no Content-Length. Returns the HTTP status, or -1 on
+ * error. */
+static int
+http_read_response_head(HTTP_CONN* conn, long long* p_content_length)
+{
+    char line[1024];
+    int status;
+
+    if(http_read_line(conn, line, sizeof(line)) != 0  ||
+       sscanf(line, "HTTP/%*u.%*u %d", &status) != 1)
+        return -1;
+
+    *p_content_length = -1;
+    while(1) {
+        if(http_read_line(conn, line, sizeof(line)) != 0)
+            return -1;
+        if(line[0] == '\0')
+            break;
+        if(http_header_is(line, "Content-Length"))
+            *p_content_length = strtoll(line + strlen("Content-Length:"), NULL, 10);
+        else if(http_header_is(line, "Transfer-Encoding"))
+            return -1;  /* We always speak HTTP/1.0 where body is sent, so no chunked encoding. */
+    }
+
+    return status;
+}
+
+/* Read the body. If content_length is -1, read until the server closes the
+ * connection. */
+static int
+http_read_body(HTTP_CONN* conn, long long content_length, BUFFER* data)
+{
+    size_t n;
+
+    while(content_length != 0) {
+        if(http_fill(conn) != 0)
+            return (content_length < 0 ? 0 : -1);
+
+        n = conn->len - conn->pos;
+        if(content_length > 0  &&  (long long) n > content_length)
+            n = (size_t) content_length;
+        if(data != NULL  &&  buffer_append(data, conn->buffer + conn->pos, n) != 0)
+            return -1;
+        conn->pos += n;
+        if(content_length > 0)
+            content_length -= (long long) n;
+    }
+
+    return 0;
+}
+
+static void
+http_format_request(CACHE_HTTP_BACKEND* backend, char* buffer, size_t size,
+                    const char* method, const char* protocol, uint64_t key,
+                    const char* extra_headers)
+{
+    snprintf(buffer, size, "%s %s/%02x/%014llx.json %s\r\n"
+             "Host: %s\r\n"
+             "User-Agent: docbaker/%s\r\n"
+             "%s"
+             "\r\n",
+             method, backend->prefix, (unsigned) (key >> 56),
+             (unsigned long long) (key & 0x00ffffffffffffffULL), protocol,
+             backend->host, PACKAGE_VERSION, extra_headers);
+}
+
+static int
+cache_http_get(CACHE_BACKEND* b, uint64_t key, BUFFER* data)
+{
+    CACHE_HTTP_BACKEND* backend = (CACHE_HTTP_BACKEND*) b;
+    char request[PATH_MAX + 512];
+    HTTP_CONN conn;
+    long long content_length;
+    int status;
+    int ret = CACHE_BACKEND_ERROR;
+
+    if(http_connect(backend, &conn) != 0)
+        return CACHE_BACKEND_ERROR;
+
+    http_format_request(backend, request, sizeof(request), "GET", "HTTP/1.0", key, "");
+    if(http_send(&conn, request, strlen(request)) != 0)
+        goto out;
+
+    status = http_read_response_head(&conn, &content_length);
+    if(status == 200) {
+        if(http_read_body(&conn, content_length, data) == 0)
+            ret = CACHE_BACKEND_FOUND;
+    } else if(status == 404) {
+        ret = CACHE_BACKEND_NOT_FOUND;
+    }
+
+out:
+    if(ret == CACHE_BACKEND_ERROR)
+        http_warn(backend, _("GET failed"));
+    http_disconnect(&conn);
+    return ret;
+}
+
+static int
+cache_http_put(CACHE_BACKEND* b, uint64_t key, const void* data, size_t size)
+{
+    CACHE_HTTP_BACKEND* backend = (CACHE_HTTP_BACKEND*) b;
+    char request[PATH_MAX + 512];
+    char headers[128];
+    HTTP_CONN conn;
+    long long content_length;
+    int status;
+    int ret = -1;
+
+    if(http_connect(backend, &conn) != 0)
+        return -1;
+
+    snprintf(headers, sizeof(headers), "Content-Type: application/json\r\n"
+             "Content-Length: %lu\r\n", (unsigned long) size);
+    http_format_request(backend, request, sizeof(request), "PUT", "HTTP/1.0", key, headers);
+    if(http_send(&conn, request, strlen(request)) != 0  ||  http_send(&conn, data, size) != 0)
+        goto out;
+
+    status = http_read_response_head(&conn, &content_length);
+    if(status >= 200  &&  status < 300)
+        ret = 0;
+
+out:
+    if(ret != 0)
+        http_warn(backend, _("PUT failed"));
+    http_disconnect(&conn);
+    return ret;
+}
+
+/* Pipeline HEAD requests for the keys over a single connection. Returns
+ * count of the keys resolved; that may be less than n if the server closes
+ * the connection prematurely (e.g. it does not support keep-alive). */
+static size_t
+cache_http_exists_pipelined(CACHE_HTTP_BACKEND* backend, const uint64_t* keys,
+                            size_t n, int* exists)
+{
+    char request[PATH_MAX + 512];
+    HTTP_CONN conn;
+    long long content_length;
+    size_t i;
+    int status;
+
+    if(http_connect(backend, &conn) != 0)
+        return 0;
+
+    for(i = 0; i < n; i++) {
+        http_format_request(backend, request, sizeof(request), "HEAD", "HTTP/1.1", keys[i],
+                            (i < n - 1 ? "" : "Connection: close\r\n"));
+        if(http_send(&conn, request, strlen(request)) != 0)
+            break;
+    }
+
+    /* (Responses to HEAD never have a body.) */
+    for(i = 0; i < n; i++) {
+        status = http_read_response_head(&conn, &content_length);
+        if(status == 200)
+            exists[i] = 1;
+        else if(status == 404)
+            exists[i] = 0;
+        else
+            break;
+    }
+
+    http_disconnect(&conn);
+    return i;
+}
+
+static int
+cache_http_exists(CACHE_BACKEND* b, const uint64_t* keys, size_t n, int* exists)
+{
+    CACHE_HTTP_BACKEND* backend = (CACHE_HTTP_BACKEND*) b;
+    size_t done = 0;
+    size_t batch;
+    size_t n_resolved;
+
+    while(done < n) {
+        batch = (n - done < HTTP_EXISTS_BATCH) ? n - done : HTTP_EXISTS_BATCH;
+        n_resolved = cache_http_exists_pipelined(backend, keys + done, batch, exists + done);
+        if(n_resolved == 0) {
+            http_warn(backend, _("HEAD failed"));
+            return -1;
+        }
+        done += n_resolved;
+    }
+
+    return 0;
+}
+
+static void
+cache_http_destroy(CACHE_BACKEND* b)
+{
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    free(b);
+}
+
+CACHE_BACKEND*
+cache_http_backend_create(const char* url)
+{
+    CACHE_HTTP_BACKEND* backend;
+    const char* host;
+    const char* host_end;
+    const char* port = "80";
+    size_t port_len = 2;
+    const char* path;
+    size_t len;
+#ifdef _WIN32
+    WSADATA wsa_data;
+#endif
+
+    if(strncmp(url, "http://", 7) != 0)
+        FATAL(_("Unsupported cache URL '%s' (only http:// is supported)."), url);
+    host = url + 7;
+    if(host[0] == '[') {
+        /* IPv6 literal. */
+        host++;
+        host_end = strchr(host, ']');
+        if(host_end == NULL)
+            FATAL(_("Malformed cache URL '%s'."), url);
+        path = host_end + 1;
+    } else {
+        host_end = host + strcspn(host, ":/");
+        path = host_end;
+    }
+    if(path[0] == ':') {
+        port = path + 1;
+        port_len = strcspn(port, "/");
+        path = port + port_len;
+    }
+
+    backend = (CACHE_HTTP_BACKEND*) calloc(1, sizeof(CACHE_HTTP_BACKEND));
+    CHECK(backend != NULL);
+
+    len = strlen(path);
+    while(len > 0  &&  path[len-1] == '/')
+        len--;
+    if(host_end - host == 0  ||  (size_t) (host_end - host) >= sizeof(backend->host)  ||
+       port_len == 0  ||  port_len >= sizeof(backend->port)  ||  len >= sizeof(backend->prefix))
+        FATAL(_("Malformed cache URL '%s'."), url);
+    memcpy(backend->host, host, host_end - host);
+    memcpy(backend->port, port, port_len);
+    memcpy(backend->prefix, path, len);
+
+#ifdef _WIN32
+    if(WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+        FATAL(_("Cannot initialize Winsock."));
+#endif
+
+    backend->base.is_remote = 1;
+    backend->base.get = cache_http_get;
+    backend->base.put = cache_http_put;
+    backend->base.exists = cache_http_exists;
+    backend->base.destroy = cache_http_destroy;
+    return &backend->base;
+}
@@ -0,0 +1,165 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "explain.h"
+#include "json.h"
+#include "thread_util.h"
+
+
+static FILE* explain_file = NULL;
+static MUTEX explain_mutex;
+
+
+void
+explain_open(const char* path)
+{
+    explain_file = fopen(path, "w");
+    if(explain_file == NULL)
+        FATAL("%s (%s)", strerror(errno), path);
+    mutex_init(&explain_mutex);
+}
+
+void
+explain_close(void)
+{
+    if(explain_file == NULL)
+        return;
+
+    if(fclose(explain_file) != 0)
+        WARN("%s", strerror(errno));
+    explain_file = NULL;
+    mutex_fini(&explain_mutex);
+}
+
+int
+explain_is_enabled(void)
+{
+    return (explain_file != NULL);
+}
+
+
+static int
+explain_callback(const char* data, size_t size, void* userdata)
+{
+    CHECK(buffer_append((BUFFER*) userdata, data, size) == 0);
+    return 0;
+}
+
+static void
+explain_key(BUFFER* line, const char* key)
+{
+    explain_callback((buffer_is_empty(line) ? "{" : ","), 1, line);
+    json_dump_string(key, strlen(key), explain_callback, line);
+    explain_callback(":", 1, line);
+}
+
+static void
+explain_string(BUFFER* line, const char* key, const char* str)
+{
+    explain_key(line, key);
+    if(str != NULL)
+        json_dump_string(str, strlen(str), explain_callback, line);
+    else
+        explain_callback("null", 4, line);
+}
+
+static void
+explain_hash(BUFFER* line, const char* key, uint64_t hash)
+{
+    char buffer[32];
+
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) hash);
+    explain_string(line, key, buffer);
+}
+
+static void
+explain_uint64(BUFFER* line, const char* key, uint64_t u64)
+{
+    explain_key(line, key);
+    json_dump_uint64(u64, explain_callback, line);
+}
+
+static void
+explain_write_line(BUFFER* line)
+{
+    explain_callback("}\n", 2, line);
+
+    /* Write the whole line at once so lines from more threads do not
+     * interleave. */
+    mutex_lock(&explain_mutex);
+    if(fwrite(buffer_data(line), 1, buffer_size(line), explain_file) != buffer_size(line))
+        WARN("%s", strerror(errno));
+    mutex_unlock(&explain_mutex);
+}
+
+void
+explain_input(const char* path, const char* result,
+              const CACHE_EXPLAIN* explain, uint64_t usec)
+{
+    BUFFER line = BUFFER_INITIALIZER;
+
+    if(explain_file == NULL)
+        return;
+
+    explain_string(&line, "kind", "input");
+    explain_string(&line, "path", path);
+    explain_string(&line, "result", result);
+    if(explain != NULL) {
+        explain_string(&line, "changed", explain->changed);
+        explain_string(&line, "reason", (explain->changed != NULL ? explain->reason : NULL));
+        explain_hash(&line, "key", explain->key);
+        explain_hash(&line, "content", explain->content_hash);
+        explain_hash(&line, "options", explain->options_hash);
+        explain_hash(&line, "tool", explain->tool_hash);
+    } else {
+        explain_string(&line, "changed", "disabled");
+        explain_string(&line, "reason", _("caching is disabled"));
+    }
+    explain_uint64(&line, "usec", usec);
+    explain_write_line(&line);
+
+    buffer_fini(&line);
+}
+
+void
+explain_output(const char* path, const char* result, const char* changed,
+               const uint64_t* deps_hash, uint64_t usec)
+{
+    BUFFER line = BUFFER_INITIALIZER;
+
+    if(explain_file == NULL)
+        return;
+
+    explain_string(&line, "kind", "output");
+    explain_string(&line, "path", path);
+    explain_string(&line, "result", result);
+    explain_string(&line, "changed", changed);
+    if(deps_hash != NULL)
+        explain_hash(&line, "deps", *deps_hash);
+    explain_uint64(&line, "usec", usec);
+    explain_write_line(&line);
+
+    buffer_fini(&line);
+}
@@ -0,0 +1,69 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_EXPLAIN_H
+#define DOCBAKER_EXPLAIN_H
+
+#include "misc.h"
+#include "cache.h"
+
+
+/* Machine readable log of the work done in the run (see --explain=FILE).
+ *
+ * The log has one JSON object per line. There is a line for each input
+ * file:
+ *
+ *   {"kind":"input", "path":..., "result":"hit"|"parsed"|"failed",
+ *    "changed":<CACHE_CHANGED_xxxx or null>, "reason":...,
+ *    "key":..., "content":..., "options":..., "tool":..., "usec":...}
+ *
+ * where "key" is the cache key and "content", "options" and "tool" are its
+ * components (hashes of the file contents, of the libclang command line and
+ * of DocBaker version); and for each output file:
+ *
+ *   {"kind":"output", "path":..., "result":"written"|"unchanged"|
+ *    "up-to-date"|"deleted", "changed":"new"|"inputs"|"missing"|null,
+ *    "deps":..., "usec":...}
+ *
+ * where "deps" is the hash of the inputs of the page (if known). "usec" is
+ * the time spent on the file, i.e. looking it up in the cache and parsing
+ * it for inputs, and rendering and writing it for outputs.
+ *
+ * All hashes are written as 16 hexadecimal digits.
+ */
+
+void explain_open(const char* path);
+void explain_close(void);
+int explain_is_enabled(void);
+
+/* These may be called from any thread. The `explain` is NULL if the cache
+ * is not used at all. */
+void explain_input(const char* path, const char* result,
+                   const CACHE_EXPLAIN* explain, uint64_t usec);
+void explain_output(const char* path, const char* result, const char* changed,
+                    const uint64_t* deps_hash, uint64_t usec);
+
+
+#endif  /* DOCBAKER_EXPLAIN_H */
@@ -24,16 +24,520 @@
  */
 
 #include "gen_html.h"
-#include "path_util.h"
+#include "arena.h"
+#include "fnv1a.h"
+#include "htable.h"
+#include "output.h"
 
 
+/* Bump whenever the generated HTML changes, so pages rendered by an older
+ * version are not mistaken for up to date ones. */
+#define GEN_HTML_FORMAT_VERSION     2
+
+#define GEN_HTML_INDEX_PAGE         "index.html"
+
+
+/* Pages are rendered solely from these structures (and never look into the
+ * store directly). This way the store may be either a VALUE tree or a
+ * snapshot, and, more importantly, a hash of the structures covers all the
+ * inputs of the page: If it has not changed since the previous run, the page
+ * does not need to be rendered at all.
+ */
+
+typedef struct GEN_HTML_STR {
+    const char* str;
+    size_t len;
+} GEN_HTML_STR;
+
+typedef struct GEN_HTML_SYM {
+    const char* kind;       /* CSS class */
+    GEN_HTML_STR name;
+    GEN_HTML_STR long_name;
+    GEN_HTML_STR doc;
+    char anchor[24];
+    size_t first_link;      /* Index into GEN_HTML_CTX::links */
+    size_t n_links;
+} GEN_HTML_SYM;
+
+/* Link to another symbol (from its references). */
+typedef struct GEN_HTML_LINK {
+    GEN_HTML_STR name;
+    char href[64];
+} GEN_HTML_LINK;
+
+typedef struct GEN_HTML_FILE {
+    GEN_HTML_STR path;
+    char page[32];
+} GEN_HTML_FILE;
+
+typedef struct GEN_HTML_CTX {
+    OUTPUT_DIR dir;
+    uint64_t base_hash;     /* Covers the generator itself and its options. */
+    BUFFER files;           /* GEN_HTML_FILE[] (for the index page) */
+    BUFFER syms;            /* GEN_HTML_SYM[] of the current file */
+    BUFFER links;           /* GEN_HTML_LINK[] of the current file */
+    BUFFER page;
+} GEN_HTML_CTX;
+
+
+static uint64_t
+gen_html_hash_str(uint64_t hash, GEN_HTML_STR s)
+{
+    uint64_t len = s.len;
+
+    /* Hash the length too, so ("ab","c") and ("a","bc") differ. */
+    hash = fnv1a_64(hash, &len, sizeof(len));
+    return fnv1a_64(hash, s.str, s.len);
+}
+
+static void
+gen_html_page_name(char page[32], GEN_HTML_STR path)
+{
+    snprintf(page, 32, "file-%016llx.html",
+             (unsigned long long) fnv1a_64(FNV1A_BASE_64, path.str, path.len));
+}
+
+/* Symbols are identified within the page by a hash of the long name (which
+ * is unique in the store). */
+static void
+gen_html_anchor_name(char anchor[24], GEN_HTML_STR long_name)
+{
+    snprintf(anchor, 24, "sym-%016llx",
+             (unsigned long long) fnv1a_64(FNV1A_BASE_64, long_name.str, long_name.len));
+}
+
+static void
+gen_html_append(GEN_HTML_CTX* ctx, const char* str)
+{
+    CHECK(buffer_append(&ctx->page, str, strlen(str)) == 0);
+}
+
+static void
+gen_html_append_escaped(GEN_HTML_CTX* ctx, GEN_HTML_STR s)
+{
+    size_t off = 0;
+    size_t i;
+    const char* entity;
+
+    for(i = 0; i < s.len; i++) {
+        switch(s.str[i]) {
+            case '&':   entity = "&amp;"; break;
+            case '<':   entity = "&lt;"; break;
+            case '>':   entity = "&gt;"; break;
+            case '"':   entity = "&quot;"; break;
+            default:    continue;
+        }
+
+        CHECK(buffer_append(&ctx->page, s.str + off, i - off) == 0);
+        gen_html_append(ctx, entity);
+        off = i + 1;
+    }
+    CHECK(buffer_append(&ctx->page, s.str + off, s.len - off) == 0);
+}
+
+static void
+gen_html_page_begin(GEN_HTML_CTX* ctx, GEN_HTML_STR title)
+{
+    buffer_clear(&ctx->page);
+    gen_html_append(ctx, "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>");
+    gen_html_append_escaped(ctx, title);
+    gen_html_append(ctx, "</title>\n</head>\n<body>\n<h1>");
+    gen_html_append_escaped(ctx, title);
+    gen_html_append(ctx, "</h1>\n");
+}
+
+static void
+gen_html_page_end(GEN_HTML_CTX* ctx, const char* name, uint64_t deps_hash)
+{
+    gen_html_append(ctx, "</body>\n</html>\n");
+    output_dir_write(&ctx->dir, name, deps_hash, buffer_data(&ctx->page), buffer_size(&ctx->page));
+}
+
+static void
+gen_html_begin(GEN_HTML_CTX* ctx, const char* output_dir, const char* skin)
+{
+    static const unsigned format_version = GEN_HTML_FORMAT_VERSION;
+
+    output_dir_open(&ctx->dir, output_dir);
+    ctx->base_hash = fnv1a_64(FNV1A_BASE_64, PACKAGE_VERSION, strlen(PACKAGE_VERSION) + 1);
+    ctx->base_hash = fnv1a_64(ctx->base_hash, &format_version, sizeof(format_version));
+    ctx->base_hash = fnv1a_64(ctx->base_hash, skin, strlen(skin) + 1);
+    buffer_init(&ctx->files);
+    buffer_init(&ctx->syms);
+    buffer_init(&ctx->links);
+    buffer_init(&ctx->page);
+}
+
+static void
+gen_html_add_sym(GEN_HTML_CTX* ctx, const char* kind, GEN_HTML_STR name,
+                 GEN_HTML_STR long_name, GEN_HTML_STR doc)
+{
+    GEN_HTML_SYM sym;
+
+    sym.kind = kind;
+    sym.name = name;
+    sym.long_name = long_name;
+    sym.doc = doc;
+    gen_html_anchor_name(sym.anchor, long_name);
+    sym.first_link = buffer_size(&ctx->links) / sizeof(GEN_HTML_LINK);
+    sym.n_links = 0;
+    CHECK(buffer_append(&ctx->syms, &sym, sizeof(GEN_HTML_SYM)) == 0);
+}
+
+/* Add a link to the symbol added last, pointing to the symbol `long_name`
+ * declared in the file `path`. */
+static void
+gen_html_add_link(GEN_HTML_CTX* ctx, GEN_HTML_STR name, GEN_HTML_STR path, GEN_HTML_STR long_name)
+{
+    GEN_HTML_SYM* sym = ((GEN_HTML_SYM*) buffer_data(&ctx->syms)) +
+                        (buffer_size(&ctx->syms) / sizeof(GEN_HTML_SYM) - 1);
+    GEN_HTML_LINK link;
+    char page[32];
+    char anchor[24];
+
+    gen_html_page_name(page, path);
+    gen_html_anchor_name(anchor, long_name);
+    link.name = name;
+    snprintf(link.href, sizeof(link.href), "%s#%s", page, anchor);
+    CHECK(buffer_append(&ctx->links, &link, sizeof(GEN_HTML_LINK)) == 0);
+    sym->n_links++;
+}
+
+/* Render page for the given file from the symbols added since the last
+ * call. */
+static void
+gen_html_file_page(GEN_HTML_CTX* ctx, GEN_HTML_STR path)
+{
+    const GEN_HTML_SYM* syms = (const GEN_HTML_SYM*) buffer_data(&ctx->syms);
+    size_t n_syms = buffer_size(&ctx->syms) / sizeof(GEN_HTML_SYM);
+    const GEN_HTML_LINK* links = (const GEN_HTML_LINK*) buffer_data(&ctx->links);
+    size_t n_links = buffer_size(&ctx->links) / sizeof(GEN_HTML_LINK);
+    GEN_HTML_FILE file;
+    uint64_t deps_hash;
+    size_t i, j;
+
+    file.path = path;
+    gen_html_page_name(file.page, path);
+    CHECK(buffer_append(&ctx->files, &file, sizeof(GEN_HTML_FILE)) == 0);
+
+    /* Links point to pages and anchors derived from paths and long names of
+     * the targets, so hashing the hrefs covers any move of the target. */
+    deps_hash = gen_html_hash_str(ctx->base_hash, path);
+    for(i = 0; i < n_syms; i++) {
+        deps_hash = fnv1a_64(deps_hash, syms[i].kind, strlen(syms[i].kind) + 1);
+        deps_hash = gen_html_hash_str(deps_hash, syms[i].name);
+        deps_hash = gen_html_hash_str(deps_hash, syms[i].long_name);
+        deps_hash = gen_html_hash_str(deps_hash, syms[i].doc);
+        deps_hash = fnv1a_64(deps_hash, &syms[i].n_links, sizeof(size_t));
+    }
+    for(i = 0; i < n_links; i++) {
+        deps_hash = gen_html_hash_str(deps_hash, links[i].name);
+        deps_hash = fnv1a_64(deps_hash, links[i].href, strlen(links[i].href) + 1);
+    }
+
+    if(!output_dir_is_up_to_date(&ctx->dir, file.page, deps_hash)) {
+        gen_html_page_begin(ctx, path);
+        for(i = 0; i < n_syms; i++) {
+            gen_html_append(ctx, "<div class=\"");
+            gen_html_append(ctx, syms[i].kind);
+            gen_html_append(ctx, "\" id=\"");
+            gen_html_append(ctx, syms[i].anchor);
+            gen_html_append(ctx, "\">\n<h2>");
+            gen_html_append_escaped(ctx, syms[i].name);
+            gen_html_append(ctx, "</h2>\n");
+            if(syms[i].long_name.len > 0) {
+                gen_html_append(ctx, "<pre class=\"declaration\">");
+                gen_html_append_escaped(ctx, syms[i].long_name);
+                gen_html_append(ctx, "</pre>\n");
+            }
+            if(syms[i].doc.len > 0) {
+                gen_html_append(ctx, "<div class=\"doc\">");
+                gen_html_append_escaped(ctx, syms[i].doc);
+                gen_html_append(ctx, "</div>\n");
+            }
+            if(syms[i].n_links > 0) {
+                gen_html_append(ctx, "<p class=\"refs\">See also: ");
+                for(j = syms[i].first_link; j < syms[i].first_link + syms[i].n_links; j++) {
+                    if(j > syms[i].first_link)
+                        gen_html_append(ctx, ", ");
+                    gen_html_append(ctx, "<a href=\"");
+                    gen_html_append(ctx, links[j].href);
+                    gen_html_append(ctx, "\">");
+                    gen_html_append_escaped(ctx, links[j].name);
+                    gen_html_append(ctx, "</a>");
+                }
+                gen_html_append(ctx, "</p>\n");
+            }
+            gen_html_append(ctx, "</div>\n");
+        }
+        gen_html_page_end(ctx, file.page, deps_hash);
+    }
+
+    buffer_clear(&ctx->syms);
+    buffer_clear(&ctx->links);
+}
+
+static void
+gen_html_end(GEN_HTML_CTX* ctx)
+{
+    static const GEN_HTML_STR title = { "Files", 5 };
+    const GEN_HTML_FILE* files = (const GEN_HTML_FILE*) buffer_data(&ctx->files);
+    size_t n_files = buffer_size(&ctx->files) / sizeof(GEN_HTML_FILE);
+    uint64_t deps_hash;
+    size_t i;
+
+    /* The index only lists the files and links to their pages (whose names
+     * are derived from the paths), so it does not depend on anything else. */
+    deps_hash = ctx->base_hash;
+    for(i = 0; i < n_files; i++)
+        deps_hash = gen_html_hash_str(deps_hash, files[i].path);
+
+    if(!output_dir_is_up_to_date(&ctx->dir, GEN_HTML_INDEX_PAGE, deps_hash)) {
+        gen_html_page_begin(ctx, title);
+        gen_html_append(ctx, "<ul class=\"files\">\n");
+        for(i = 0; i < n_files; i++) {
+            gen_html_append(ctx, "<li><a href=\"");
+            gen_html_append(ctx, files[i].page);
+            gen_html_append(ctx, "\">");
+            gen_html_append_escaped(ctx, files[i].path);
+            gen_html_append(ctx, "</a></li>\n");
+        }
+        gen_html_append(ctx, "</ul>\n");
+        gen_html_page_end(ctx, GEN_HTML_INDEX_PAGE, deps_hash);
+    }
+
+    output_dir_close(&ctx->dir);
+    buffer_fini(&ctx->files);
+    buffer_fini(&ctx->syms);
+    buffer_fini(&ctx->links);
+    buffer_fini(&ctx->page);
+}
+
+
+static GEN_HTML_STR
+gen_html_str(const char* str)
+{
+    GEN_HTML_STR s;
+
+    s.str = (str != NULL ? str : "");
+    s.len = strlen(s.str);
+    return s;
+}
+
+static const char*
+gen_html_kind_class(unsigned kind)
+{
+    return (kind == STORE_KIND_TYPE ? "type" : "function");
+}
+
 void
-gen_html(const char* output_dir, const char* skin, const VALUE* store)
+gen_html(const char* output_dir, const char* skin, const STORE* store)
 {
-    if(mkdir(output_dir, 0755) != 0) {
-        if(!path_is_dir(output_dir))
-            FATAL("%s (%s)", strerror(errno), output_dir);
+    GEN_HTML_CTX ctx;
+    const STORE_FILE* file;
+    const STORE_REF* refs;
+    STORE_ID id;
+    STORE_ID target;
+    size_t i;
+    uint32_t j;
+    unsigned k, n_refs;
+
+    /* In a frozen store, files and symbols are in the order we need for the
+     * output already (the same as in a snapshot, i.e. by path, and then by
+     * kind and long name). */
+    CHECK(store_is_frozen(store));
+
+    gen_html_begin(&ctx, output_dir, skin);
+
+    for(i = 0; i < store_file_count(store); i++) {
+        file = store_file(store, i);
+
+        for(j = 0; j < file->n_symbols; j++) {
+            id = file->symbols[j];
+            gen_html_add_sym(&ctx, gen_html_kind_class(store_symbol_kind(store, id)),
+                             gen_html_str(store_symbol_name(store, id)),
+                             gen_html_str(store_symbol_long_name(store, id)),
+                             gen_html_str(store_symbol_doc(store, id)));
+
+            /* References are resolved already by store_link(). */
+            refs = store_symbol_refs(store, id, &n_refs);
+            for(k = 0; k < n_refs; k++) {
+                target = refs[k].id;
+                if(target == STORE_NO_ID)
+                    continue;
+                gen_html_add_link(&ctx, gen_html_str(store_symbol_name(store, target)),
+                                  gen_html_str(store_file_path(store, store_symbol_file(store, target))),
+                                  gen_html_str(store_symbol_long_name(store, target)));
+            }
+        }
+
+        gen_html_file_page(&ctx, gen_html_str(store_file_path(store, i)));
     }
 
+    gen_html_end(&ctx);
+}
+
+
+/* Sections of the file in the snapshot, in their (sorted) order. */
+static const struct {
+    const char* section;
+    const char* kind;
+} gen_html_snapshot_sections[] = {
+    { "functions", "function" },
+    { "types", "type" }
+};
+
+/* The snapshot has no USR index, so we build one before rendering the first
+ * page (so that following any reference is O(1)). */
+typedef struct GEN_HTML_TARGET {
+    const char* usr;
+    GEN_HTML_STR name;
+    GEN_HTML_STR long_name;
+    GEN_HTML_STR path;
+} GEN_HTML_TARGET;
+
+static int
+gen_html_target_cmp(const void* item, const void* key)
+{
+    return strcmp(((const GEN_HTML_TARGET*) item)->usr, (const char*) key);
+}
+
+static GEN_HTML_STR
+gen_html_snapshot_str(const SNAPSHOT* snap, const SNAPSHOT_NODE* dict, const char* key)
+{
+    GEN_HTML_STR s = { "", 0 };
+    const SNAPSHOT_NODE* node;
+
+    node = snapshot_dict_get(snap, dict, key);
+    if(node != NULL  &&  snapshot_type(node) == VALUE_STRING  &&  snapshot_string(snap, node) != NULL) {
+        s.str = snapshot_string(snap, node);
+        s.len = snapshot_string_length(node);
+    }
+    return s;
+}
+
+static GEN_HTML_STR
+gen_html_snapshot_key(const SNAPSHOT* snap, const SNAPSHOT_NODE* node)
+{
+    GEN_HTML_STR s = { "", 0 };
+
+    if(snapshot_key(snap, node) != NULL) {
+        s.str = snapshot_key(snap, node);
+        s.len = node->key_len;
+    }
+    return s;
+}
+
+/* Get name and long name of the symbol, with the same fallbacks as
+ * store_import() has. */
+static void
+gen_html_snapshot_names(const SNAPSHOT* snap, const SNAPSHOT_NODE* sym,
+                        GEN_HTML_STR* name, GEN_HTML_STR* long_name)
+{
+    *long_name = gen_html_snapshot_str(snap, sym, "long_name");
+    if(long_name->len == 0)
+        *long_name = gen_html_snapshot_key(snap, sym);
+    *name = gen_html_snapshot_str(snap, sym, "name");
+    if(name->len == 0)
+        *name = *long_name;
+}
+
+static void
+gen_html_snapshot_index(const SNAPSHOT* snap, const SNAPSHOT_NODE* files,
+                        HTABLE* index, ARENA* arena)
+{
+    const SNAPSHOT_NODE* file;
+    const SNAPSHOT_NODE* syms;
+    const SNAPSHOT_NODE* sym;
+    GEN_HTML_TARGET* target;
+    GEN_HTML_STR usr;
+    size_t i, j, k;
+    uint64_t hash;
+
+    for(i = 0; i < snapshot_size(files); i++) {
+        file = snapshot_child(snap, files, i);
+        for(k = 0; k < sizeof(gen_html_snapshot_sections) / sizeof(gen_html_snapshot_sections[0]); k++) {
+            syms = snapshot_dict_get(snap, file, gen_html_snapshot_sections[k].section);
+            if(syms == NULL  ||  snapshot_type(syms) != VALUE_DICT)
+                continue;
+            for(j = 0; j < snapshot_size(syms); j++) {
+                sym = snapshot_child(snap, syms, j);
+                usr = gen_html_snapshot_str(snap, sym, "usr");
+                if(usr.len == 0)
+                    continue;
+                hash = fnv1a_64(FNV1A_BASE_64, usr.str, usr.len);
+                if(htable_lookup(index, hash, gen_html_target_cmp, usr.str) != NULL)
+                    continue;
+
+                target = (GEN_HTML_TARGET*) arena_alloc(arena, sizeof(GEN_HTML_TARGET));
+                target->usr = usr.str;
+                gen_html_snapshot_names(snap, sym, &target->name, &target->long_name);
+                target->path = gen_html_snapshot_key(snap, file);
+                CHECK(htable_insert(index, hash, target) == 0);
+            }
+        }
+    }
+}
+
+void
+gen_html_snapshot(const char* output_dir, const char* skin, const SNAPSHOT* snap)
+{
+    GEN_HTML_CTX ctx;
+    HTABLE index = HTABLE_INITIALIZER;
+    ARENA arena = ARENA_INITIALIZER;
+    const SNAPSHOT_NODE* files;
+    const SNAPSHOT_NODE* file;
+    const SNAPSHOT_NODE* syms;
+    const SNAPSHOT_NODE* sym;
+    const SNAPSHOT_NODE* refs;
+    const GEN_HTML_TARGET* target;
+    const char* usr;
+    size_t i, j, k, r;
+    GEN_HTML_STR name;
+    GEN_HTML_STR long_name;
+
+    gen_html_begin(&ctx, output_dir, skin);
+    arena_init(&arena);
+
+    files = snapshot_dict_get(snap, snapshot_root(snap), "files");
+    if(files != NULL  &&  snapshot_type(files) == VALUE_DICT) {
+        gen_html_snapshot_index(snap, files, &index, &arena);
+
+        for(i = 0; i < snapshot_size(files); i++) {
+            file = snapshot_child(snap, files, i);
+            for(k = 0; k < sizeof(gen_html_snapshot_sections) / sizeof(gen_html_snapshot_sections[0]); k++) {
+                syms = (snapshot_type(file) == VALUE_DICT ?
+                        snapshot_dict_get(snap, file, gen_html_snapshot_sections[k].section) : NULL);
+                if(syms == NULL  ||  snapshot_type(syms) != VALUE_DICT)
+                    continue;
+                for(j = 0; j < snapshot_size(syms); j++) {
+                    sym = snapshot_child(snap, syms, j);
+                    if(snapshot_type(sym) != VALUE_DICT)
+                        continue;
+                    gen_html_snapshot_names(snap, sym, &name, &long_name);
+                    gen_html_add_sym(&ctx, gen_html_snapshot_sections[k].kind, name, long_name,
+                                     gen_html_snapshot_str(snap, sym, "doc"));
+
+                    refs = snapshot_dict_get(snap, sym, "refs");
+                    if(refs == NULL  ||  snapshot_type(refs) != VALUE_ARRAY)
+                        continue;
+                    for(r = 0; r < snapshot_size(refs); r++) {
+                        usr = snapshot_string(snap, snapshot_child(snap, refs, r));
+                        if(usr == NULL)
+                            continue;
+                        target = (const GEN_HTML_TARGET*) htable_lookup(&index,
+                                    fnv1a_64(FNV1A_BASE_64, usr, strlen(usr)), gen_html_target_cmp, usr);
+                        if(target != NULL)
+                            gen_html_add_link(&ctx, target->name, target->path, target->long_name);
+                    }
+                }
+            }
+
+            gen_html_file_page(&ctx, gen_html_snapshot_key(snap, file));
+        }
+    }
 
+    htable_fini(&index, NULL);
+    arena_fini(&arena);
+    gen_html_end(&ctx);
 }
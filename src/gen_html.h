@@ -27,10 +27,15 @@
 #define DOCBAKER_GEN_HTML_H
 
 #include "misc.h"
-#include "value.h"
+#include "snapshot.h"
+#include "store.h"
 
 
-void gen_html(const char* output_dir, const char* skin, const VALUE* store);
+/* The store has to be frozen (see store_freeze()). */
+void gen_html(const char* output_dir, const char* skin, const STORE* store);
+
+/* Same as gen_html() but the data come from the mapped snapshot. */
+void gen_html_snapshot(const char* output_dir, const char* skin, const SNAPSHOT* snap);
 
 
 #endif  /* DOCBAKER_GEN_HTML_H */
@@ -25,12 +25,14 @@
 
 #include "gen_json.h"
 #include "json-dom.h"
+#include "json.h"
+#include "output.h"
 
 
 static int
 gen_json_callback(const char* data, size_t size, void* userdata)
 {
-    CHECK(fwrite(data, 1, size, (FILE*) userdata) == size);
+    CHECK(buffer_append((BUFFER*) userdata, data, size) == 0);
     return 0;
 }
 
@@ -38,10 +40,98 @@ gen_json_callback(const char* data, size_t size, void* userdata)
 void
 gen_json(const char* json_output_file, const VALUE* store)
 {
-    FILE* f;
+    BUFFER buf = BUFFER_INITIALIZER;
 
-    f = fopen(json_output_file, "wt");
-    CHECK(f != NULL);
-    CHECK(json_dom_dump(store, gen_json_callback, f, 0, 0) == 0);
-    fclose(f);
+    /* Render into memory first, so output_write_file() can skip the write
+     * if nothing has changed. */
+    CHECK(json_dom_dump(store, gen_json_callback, &buf, 0, 0) == 0);
+    output_write_file(json_output_file, buffer_data(&buf), buffer_size(&buf));
+    buffer_fini(&buf);
+}
+
+
+/* Same output as json_dom_dump() produces for the equivalent VALUE tree. */
+static void
+gen_json_snapshot_indent(BUFFER* f, unsigned nest_level)
+{
+    unsigned i;
+
+    for(i = 0; i < nest_level; i++)
+        gen_json_callback("\t", 1, f);
+}
+
+static void
+gen_json_snapshot_node(BUFFER* f, const SNAPSHOT* snap, const SNAPSHOT_NODE* node,
+                       unsigned nest_level)
+{
+    const SNAPSHOT_NODE* child;
+    const char* str;
+    size_t i, n;
+
+    switch(snapshot_type(node)) {
+        case VALUE_NULL:
+            gen_json_callback("null", 4, f);
+            break;
+
+        case VALUE_BOOL:
+            if(snapshot_bool(node))
+                gen_json_callback("true", 4, f);
+            else
+                gen_json_callback("false", 5, f);
+            break;
+
+        case VALUE_INT32:
+        case VALUE_INT64:
+            json_dump_int64(snapshot_int64(node), gen_json_callback, f);
+            break;
+
+        case VALUE_UINT32:
+        case VALUE_UINT64:
+            json_dump_uint64(snapshot_uint64(node), gen_json_callback, f);
+            break;
+
+        case VALUE_FLOAT:
+        case VALUE_DOUBLE:
+            json_dump_double(snapshot_double(node), gen_json_callback, f);
+            break;
+
+        case VALUE_STRING:
+            str = snapshot_string(snap, node);
+            json_dump_string((str != NULL ? str : ""), (str != NULL ? snapshot_string_length(node) : 0),
+                             gen_json_callback, f);
+            break;
+
+        case VALUE_ARRAY:
+        case VALUE_DICT:
+            gen_json_callback((snapshot_type(node) == VALUE_ARRAY ? "[\n" : "{\n"), 2, f);
+            n = snapshot_size(node);
+            for(i = 0; i < n; i++) {
+                child = snapshot_child(snap, node, i);
+                gen_json_snapshot_indent(f, nest_level + 1);
+                if(snapshot_type(node) == VALUE_DICT) {
+                    str = snapshot_key(snap, child);
+                    json_dump_string((str != NULL ? str : ""), (str != NULL ? child->key_len : 0),
+                                     gen_json_callback, f);
+                    gen_json_callback(": ", 2, f);
+                }
+                gen_json_snapshot_node(f, snap, child, nest_level + 1);
+                if(i < n - 1)
+                    gen_json_callback(",", 1, f);
+                gen_json_callback("\n", 1, f);
+            }
+            gen_json_snapshot_indent(f, nest_level);
+            gen_json_callback((snapshot_type(node) == VALUE_ARRAY ? "]" : "}"), 1, f);
+            break;
+    }
+}
+
+void
+gen_json_snapshot(const char* json_output_file, const SNAPSHOT* snap)
+{
+    BUFFER buf = BUFFER_INITIALIZER;
+
+    gen_json_snapshot_node(&buf, snap, snapshot_root(snap), 0);
+    gen_json_callback("\n", 1, &buf);
+    output_write_file(json_output_file, buffer_data(&buf), buffer_size(&buf));
+    buffer_fini(&buf);
 }
@@ -27,10 +27,14 @@
 #define DOCBAKER_GEN_JSON_H
 
 #include "misc.h"
+#include "snapshot.h"
 #include "value.h"
 
 
 void gen_json(const char* json_output_file, const VALUE* store);
 
+/* Same as gen_json() but the data come from the mapped snapshot. */
+void gen_json_snapshot(const char* json_output_file, const SNAPSHOT* snap);
+
 
 #endif  /* DOCBAKER_GEN_JSON_H */
@@ -0,0 +1,220 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "history.h"
+#include "array.h"
+#include "fnv1a.h"
+#include "htable.h"
+#include "path_util.h"
+#include "thread_util.h"
+
+
+typedef struct HISTORY_ENTRY {
+    uint64_t usec;
+    uint64_t size;
+    char path[1];
+} HISTORY_ENTRY;
+
+
+/* Entries loaded from the history file. This is read-only during the run so
+ * history_predict() needs no locking. */
+static HTABLE history_old = HTABLE_INITIALIZER;
+static ARRAY history_old_entries = ARRAY_INITIALIZER;
+
+/* Average parse speed in the history, for extrapolation of unknown files. */
+static double history_usec_per_byte = 1.0;
+
+/* New measurements from the current run. */
+static ARRAY history_new_entries = ARRAY_INITIALIZER;
+static MUTEX history_new_mutex;
+static int history_new_mutex_initialized = 0;
+
+
+static HISTORY_ENTRY*
+history_entry_new(const char* path, uint64_t size, uint64_t usec)
+{
+    HISTORY_ENTRY* entry;
+    size_t len = strlen(path);
+
+    entry = (HISTORY_ENTRY*) malloc(sizeof(HISTORY_ENTRY) + len);
+    CHECK(entry != NULL);
+    entry->usec = usec;
+    entry->size = size;
+    memcpy(entry->path, path, len + 1);
+    return entry;
+}
+
+static uint64_t
+history_hash(const char* path)
+{
+    return fnv1a_64(FNV1A_BASE_64, path, strlen(path));
+}
+
+static int
+history_entry_cmp(const void* item, const void* key)
+{
+    return strcmp(((const HISTORY_ENTRY*) item)->path, (const char*) key);
+}
+
+void
+history_load(const char* history_file)
+{
+    char line[PATH_MAX + 64];
+    HISTORY_ENTRY* entry;
+    uint64_t sum_usec = 0;
+    uint64_t sum_size = 0;
+    unsigned long long usec, size;
+    int path_offset;
+    size_t len;
+    FILE* f;
+
+    mutex_init(&history_new_mutex);
+    history_new_mutex_initialized = 1;
+
+    f = fopen(history_file, "r");
+    if(f == NULL) {
+        /* It is ok if the history does not exist yet. */
+        if(errno != ENOENT)
+            WARN("%s (%s)", strerror(errno), history_file);
+        return;
+    }
+
+    while(fgets(line, sizeof(line), f) != NULL) {
+        len = strlen(line);
+        if(len > 0  &&  line[len-1] == '\n')
+            line[--len] = '\0';
+
+        if(sscanf(line, "%llu %llu %n", &usec, &size, &path_offset) != 2  ||
+           line[path_offset] == '\0')
+        {
+            WARN(_("Ignoring malformed line in %s."), history_file);
+            continue;
+        }
+
+        entry = history_entry_new(line + path_offset, size, usec);
+        if(htable_lookup(&history_old, history_hash(entry->path), history_entry_cmp, entry->path) != NULL) {
+            free(entry);
+            continue;
+        }
+        CHECK(htable_insert(&history_old, history_hash(entry->path), entry) == 0);
+        CHECK(array_append(&history_old_entries, entry) == 0);
+        sum_usec += entry->usec;
+        sum_size += entry->size;
+    }
+
+    fclose(f);
+
+    if(sum_size > 0  &&  sum_usec > 0)
+        history_usec_per_byte = (double) sum_usec / (double) sum_size;
+    NOTE(2, _("Loaded parse history of %u files from %s."),
+            (unsigned) array_size(&history_old_entries), history_file);
+}
+
+void
+history_save(const char* history_file)
+{
+    char tmp_file[PATH_MAX];
+    HTABLE new_paths = HTABLE_INITIALIZER;
+    HISTORY_ENTRY* entry;
+    size_t i;
+    FILE* f;
+
+    if(snprintf(tmp_file, PATH_MAX, "%s.tmp", history_file) >= PATH_MAX) {
+        WARN(_("Path too long (%s)."), history_file);
+        return;
+    }
+
+    f = fopen(tmp_file, "w");
+    if(f == NULL) {
+        WARN("%s (%s)", strerror(errno), tmp_file);
+        return;
+    }
+
+    /* Fresh measurements first, then the old ones we have not re-measured
+     * (e.g. when only a subset of the files has been processed). */
+    for(i = 0; i < array_size(&history_new_entries); i++) {
+        entry = (HISTORY_ENTRY*) array_get(&history_new_entries, i);
+        fprintf(f, "%llu %llu %s\n", (unsigned long long) entry->usec,
+                (unsigned long long) entry->size, entry->path);
+        CHECK(htable_insert(&new_paths, history_hash(entry->path), entry) == 0);
+    }
+    for(i = 0; i < array_size(&history_old_entries); i++) {
+        entry = (HISTORY_ENTRY*) array_get(&history_old_entries, i);
+        if(htable_lookup(&new_paths, history_hash(entry->path), history_entry_cmp, entry->path) != NULL)
+            continue;
+        fprintf(f, "%llu %llu %s\n", (unsigned long long) entry->usec,
+                (unsigned long long) entry->size, entry->path);
+    }
+    htable_fini(&new_paths, NULL);
+
+    if(fclose(f) != 0) {
+        WARN("%s (%s)", strerror(errno), tmp_file);
+        remove(tmp_file);
+        return;
+    }
+
+    if(path_rename(tmp_file, history_file) != 0) {
+        WARN("%s (%s)", strerror(errno), history_file);
+        remove(tmp_file);
+    }
+}
+
+void
+history_fini(void)
+{
+    htable_fini(&history_old, NULL);
+    array_fini(&history_old_entries, free);
+    array_fini(&history_new_entries, free);
+    if(history_new_mutex_initialized) {
+        mutex_fini(&history_new_mutex);
+        history_new_mutex_initialized = 0;
+    }
+}
+
+uint64_t
+history_predict(const char* path, uint64_t size)
+{
+    HISTORY_ENTRY* entry;
+
+    entry = (HISTORY_ENTRY*) htable_lookup(&history_old, history_hash(path), history_entry_cmp, path);
+    if(entry != NULL)
+        return entry->usec;
+
+    return (uint64_t) ((double) size * history_usec_per_byte);
+}
+
+void
+history_record(const char* path, uint64_t size, uint64_t usec)
+{
+    HISTORY_ENTRY* entry;
+
+    if(!history_new_mutex_initialized)
+        return;
+
+    entry = history_entry_new(path, size, usec);
+    mutex_lock(&history_new_mutex);
+    CHECK(array_append(&history_new_entries, entry) == 0);
+    mutex_unlock(&history_new_mutex);
+}
@@ -0,0 +1,54 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_HISTORY_H
+#define DOCBAKER_HISTORY_H
+
+#include "misc.h"
+
+
+/* Parse history remembers how long it took to parse each input file in the
+ * previous runs. The main use is to predict the cost of parsing, so we can
+ * schedule the most expensive files first.
+ *
+ * The history file is a plain text file with one line per input file:
+ * "<duration in microseconds> <file size> <path>".
+ */
+
+void history_load(const char* history_file);
+void history_save(const char* history_file);
+void history_fini(void);
+
+/* Predict the cost (in microseconds) of parsing the file. If the file is
+ * known from the history, its last parse duration is used. Otherwise the
+ * cost is extrapolated from the file size. */
+uint64_t history_predict(const char* path, uint64_t size);
+
+/* Record the duration (in microseconds) of parsing the file. Unlike the
+ * other functions, this one may be called from any thread. */
+void history_record(const char* path, uint64_t size, uint64_t usec);
+
+
+#endif  /* DOCBAKER_HISTORY_H */
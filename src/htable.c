@@ -0,0 +1,137 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "htable.h"
+
+#include <string.h>
+
+
+/* We keep the load factor at most 1/2. With linear probing, lookups then
+ * rarely need to look at more than a few consecutive slots. */
+#define HTABLE_MIN_ALLOC        16
+
+
+static void
+htable_put_slot(HTABLE_SLOT* slots, size_t alloc, uint64_t hash, void* item)
+{
+    size_t mask = alloc - 1;
+    size_t i = (size_t) hash & mask;
+
+    while(slots[i].item != NULL)
+        i = (i + 1) & mask;
+
+    slots[i].hash = hash;
+    slots[i].item = item;
+}
+
+static int
+htable_rehash(HTABLE* table, size_t alloc)
+{
+    HTABLE_SLOT* slots;
+    size_t i;
+
+    slots = (HTABLE_SLOT*) calloc(alloc, sizeof(HTABLE_SLOT));
+    if(slots == NULL)
+        return -1;
+
+    for(i = 0; i < table->alloc; i++) {
+        if(table->slots[i].item != NULL)
+            htable_put_slot(slots, alloc, table->slots[i].hash, table->slots[i].item);
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->alloc = alloc;
+    return 0;
+}
+
+void
+htable_init(HTABLE* table)
+{
+    table->slots = NULL;
+    table->size = 0;
+    table->alloc = 0;
+}
+
+void
+htable_fini(HTABLE* table, HTABLE_DTORFUNC dtor_func)
+{
+    size_t i;
+
+    if(dtor_func != NULL) {
+        for(i = 0; i < table->alloc; i++) {
+            if(table->slots[i].item != NULL)
+                dtor_func(table->slots[i].item);
+        }
+    }
+
+    free(table->slots);
+    htable_init(table);
+}
+
+void*
+htable_lookup(const HTABLE* table, uint64_t hash, HTABLE_CMPFUNC cmp_func, const void* key)
+{
+    size_t mask;
+    size_t i;
+
+    if(table->size == 0)
+        return NULL;
+
+    mask = table->alloc - 1;
+    for(i = (size_t) hash & mask; table->slots[i].item != NULL; i = (i + 1) & mask) {
+        if(table->slots[i].hash == hash  &&  cmp_func(table->slots[i].item, key) == 0)
+            return table->slots[i].item;
+    }
+
+    return NULL;
+}
+
+int
+htable_reserve(HTABLE* table, size_t n_items)
+{
+    size_t alloc;
+
+    alloc = (table->alloc > 0 ? table->alloc : HTABLE_MIN_ALLOC);
+    while(alloc < 2 * n_items)
+        alloc *= 2;
+
+    if(alloc == table->alloc)
+        return 0;
+    return htable_rehash(table, alloc);
+}
+
+int
+htable_insert(HTABLE* table, uint64_t hash, void* item)
+{
+    if(2 * (table->size + 1) > table->alloc) {
+        if(htable_reserve(table, table->size + 1) != 0)
+            return -1;
+    }
+
+    htable_put_slot(table->slots, table->alloc, hash, item);
+    table->size++;
+    return 0;
+}
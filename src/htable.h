@@ -0,0 +1,89 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_HTABLE_H
+#define DOCBAKER_HTABLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/* Hash table of pointers, implemented with open addressing and linear
+ * probing.
+ *
+ * The table does not interpret the items in any way. The caller is
+ * responsible for computing the hash (typically with fnv1a_64()) and, for
+ * lookups, provides a function comparing a stored item with the key.
+ *
+ * Note NULL cannot be stored in the table as it denotes an empty slot.
+ */
+
+
+/* Item comparator. Returns zero if the item matches the key. */
+typedef int (*HTABLE_CMPFUNC)(const void* /*item*/, const void* /*key*/);
+
+/* Item destructor. */
+typedef void (*HTABLE_DTORFUNC)(void* /*item*/);
+
+
+typedef struct HTABLE_SLOT {
+    uint64_t hash;
+    void* item;
+} HTABLE_SLOT;
+
+typedef struct HTABLE {
+    HTABLE_SLOT* slots;
+    size_t size;
+    size_t alloc;       /* Always zero or a power of 2. */
+} HTABLE;
+
+
+#define HTABLE_INITIALIZER     { NULL, 0, 0 }
+
+
+void htable_init(HTABLE* table);
+void htable_fini(HTABLE* table, HTABLE_DTORFUNC dtor_func);
+
+/* Find an item matching the key. Returns NULL if there is no such item. */
+void* htable_lookup(const HTABLE* table, uint64_t hash,
+                    HTABLE_CMPFUNC cmp_func, const void* key);
+
+/* Add new item. Note no check whether an equal item is already present is
+ * done, so caller is supposed to call htable_lookup() first if needed.
+ *
+ * Returns zero on success, -1 on an allocation failure. */
+int htable_insert(HTABLE* table, uint64_t hash, void* item);
+
+/* Make sure the table can hold at least n_items without a rehash. */
+int htable_reserve(HTABLE* table, size_t n_items);
+
+static inline size_t
+htable_size(const HTABLE* table)
+{
+    return table->size;
+}
+
+
+#endif  /* DOCBAKER_HTABLE_H */
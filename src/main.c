@@ -25,26 +25,68 @@
 
 #include "misc.h"
 #include "array.h"
+#include "cache.h"
 #include "cmdline.h"
+#include "explain.h"
+#include "fnv1a.h"
 #include "gen_html.h"
 #include "gen_json.h"
+#include "history.h"
+#include "output.h"
+#include "htable.h"
 #include "parse_cxx.h"
 #include "path_util.h"
+#include "snapshot.h"
 #include "store.h"
+#include "thread_util.h"
+#include "work_queue.h"
 
 
 int verbose_level = 0;
 
 static int dry_run = 0;
+static int merge_mode = 0;
+static const char* cache_command = NULL;    /* "stats" or "prune" */
 static const char* argv0;
 static ARRAY argv_paths = ARRAY_INITIALIZER;
 
+/* Files listing further input paths (see --files-from). */
+static ARRAY files_from_lists = ARRAY_INITIALIZER;
+static int files_from_null = 0;
+
+/* With --shard=I/N, we process only the input files falling into the I-th
+ * of N shards. (Note shard_index is zero-based here.) */
+static unsigned shard_index = 0;
+static unsigned shard_count = 0;
+static int n_other_shard_files = 0;
+
+/* With --from-json=FILE, we do not parse anything and only render the store
+ * previously saved by the JSON generator. */
+static const char* from_json_file = NULL;
+
+/* With --from-snapshot=FILE, we render directly from the mapped snapshot
+ * (see --snapshot) without building the store at all. */
+static const char* from_snapshot_file = NULL;
+
+/* Identities of all accepted inputs (files as well as directories), so that
+ * the same physical file reached via multiple paths (e.g. through a symlinked
+ * directory) is processed only once. */
+typedef struct INPUT_ID {
+    dev_t dev;
+    ino_t ino;
+    char* canon_path;   /* Used instead of the (dev, ino) if we have no inode number. */
+    char path[1];       /* The path under which we have seen the input first. */
+} INPUT_ID;
+
+static HTABLE input_ids = HTABLE_INITIALIZER;
+
 /* For C/C++ parser. */
 static ARRAY clang_opts = ARRAY_INITIALIZER;
 
 
 #define HTML_GENERATOR                  0x01
 #define JSON_GENERATOR                  0x02
+#define SNAPSHOT_GENERATOR              0x04
 static unsigned enabled_generators = 0;
 
 /* For HTML generator. */
@@ -57,6 +99,35 @@ static const char* html_skin = DEFAULT_HTML_SKIN;
 #define DEFAULT_JSON_OUTPUT_FILE    "doc.json"
 static const char* json_output_file = DEFAULT_JSON_OUTPUT_FILE;
 
+/* For snapshot generator. */
+#define DEFAULT_SNAPSHOT_OUTPUT_FILE    "doc.snap"
+static const char* snapshot_output_file = DEFAULT_SNAPSHOT_OUTPUT_FILE;
+
+/* Parser workers. The main thread walks the input paths and feeds the
+ * parse_queue with accepted files, while the workers consume it in
+ * parallel. Each worker collects its results in its own store, so they
+ * never wait for each other; the stores are merged when all is parsed. */
+#define PARSE_QUEUE_CAPACITY        1024
+static int n_jobs = 0;                  /* zero means one per CPU core */
+static const char* parse_history_file = NULL;
+static THREAD* parse_workers = NULL;
+static WORK_QUEUE parse_queue;
+static STORE* worker_stores = NULL;
+
+typedef struct PARSE_JOB {
+    struct stat st;
+    char path[1];
+} PARSE_JOB;
+
+/* Cache of parser results (see --cache-dir). */
+static const char* cache_dir = NULL;
+static const char* cache_url = NULL;
+static int use_cache = 0;
+#define DEFAULT_CACHE_SIZE          (1024ULL * 1024ULL * 1024ULL)
+static uint64_t cache_size = DEFAULT_CACHE_SIZE;
+static int explain = 0;
+static const char* explain_file = NULL;
+
 static int n_processed_files = 0;
 
 
@@ -71,7 +142,23 @@ static void
 print_usage(void)
 {
     printf(_("Usage: %s [OPTION]... [FILE]...\n"), argv0);
+    printf(_("  or:  %s merge [OPTION]... PARTIAL_STORE...\n"), argv0);
+    printf(_("  or:  %s cache stats|prune --cache-dir=DIR [--cache-size=SIZE]\n"), argv0);
     printf(_("Generate documentation from source comments.\n"));
+    printf(_("The merge command generates the documentation from partial stores\n"
+             "created by runs with --shard.\n"));
+    printf(_("The cache command shows statistics of the cache directory, or removes\n"
+             "the least recently used entries above the size limit.\n"));
+
+    printf("\n%s\n", _("Input options:"));
+    printf("      --files-from=FILE  %s\n", _("Read further input paths from FILE (use '-' for stdin)"));
+    printf("  -0, --null             %s\n", _("Paths in --files-from are NUL-terminated, not newline-terminated"));
+    printf("      --shard=I/N        %s\n", _("Process only I-th of N shards of the input files and"));
+    printf("                         %s\n", _("write the partial store as JSON (see --json)"));
+    printf("      --from-json=FILE   %s\n", _("Do not parse anything; render the store saved in FILE"));
+    printf("                         %s\n", _("by the JSON generator"));
+    printf("      --from-snapshot=FILE\n");
+    printf("                         %s\n", _("Do not parse anything; render the snapshot FILE"));
 
     printf("\n%s\n", _("Options for C/C++ parser:"));
     printf("  -I <PATH>              %s\n", _("Add path to include search path"));
@@ -87,7 +174,21 @@ print_usage(void)
     printf("      --json[=FILE]      %s\n", _("Enable JSON generator and set its output file"));
     printf("                         (%s: %s)\n", _("default"), DEFAULT_JSON_OUTPUT_FILE);
 
+    printf("\n%s\n", _("Options for snapshot generator:"));
+    printf("      --snapshot[=FILE]  %s\n", _("Enable binary snapshot generator and set its output file"));
+    printf("                         (%s: %s)\n", _("default"), DEFAULT_SNAPSHOT_OUTPUT_FILE);
+
     printf("\n%s\n", _("Auxiliary options:"));
+    printf("  -j, --jobs=N           %s\n", _("Run N parser threads (default: one per CPU core)"));
+    printf("      --cache-dir=DIR    %s\n", _("Cache parser results in DIR and reuse them for unchanged files"));
+    printf("      --cache-url=URL    %s\n", _("Store the cached results on HTTP server at URL (http://host[:port]/path)"));
+    printf("                         %s\n", _("instead of --cache-dir (which then keeps only local metadata)"));
+    printf("      --cache-size=SIZE  %s\n", _("Limit size of the cache (suffixes K, M, G; 0 means no limit)"));
+    printf("                         (%s: 1G)\n", _("default"));
+    printf("      --explain[=FILE]   %s\n", _("Explain why each file has to be (re)parsed; with FILE, write"));
+    printf("                         %s\n", _("a JSON-lines log of all input and output files into FILE"));
+    printf("      --parse-history=FILE\n");
+    printf("                         %s\n", _("Remember parse times in FILE to schedule the slowest files first"));
     printf("  -n, --dry-run          %s\n", _("Do not generate any output"));
     printf("  -v, --verbose[=LEVEL]  %s\n", _("Increase/set verbose level"));
     printf("  -h, --help             %s\n", _("Display this help and exit"));
@@ -99,11 +200,20 @@ print_usage(void)
 
 #define OPTID_2(a,b)     (((int)(a) << 8) | ((int)(b) << 0))
 #define OPTID_3(a,b,c)   (((int)(a) << 16) | ((int)(b) << 8) | ((int)(c) << 0))
+#define OPTID_INPUT(a)   OPTID_2('I', (a))
 #define OPTID_CXX(a)     OPTID_2('C', (a))
 #define OPTID_HTML(a)    OPTID_2('H', (a))
 #define OPTID_JSON(a)    OPTID_2('J', (a))
+#define OPTID_SNAPSHOT(a) OPTID_2('S', (a))
 
 static const CMDLINE_OPTION cmdline_options[] = {
+    /* Input options. */
+    { '\0', "files-from",   OPTID_INPUT('F'), CMDLINE_OPTFLAG_REQUIREDARG },
+    { '0',  "null",         OPTID_INPUT('0'), 0 },
+    { '\0', "shard",        OPTID_INPUT('S'), CMDLINE_OPTFLAG_REQUIREDARG },
+    { '\0', "from-json",    OPTID_INPUT('J'), CMDLINE_OPTFLAG_REQUIREDARG },
+    { '\0', "from-snapshot", OPTID_INPUT('M'), CMDLINE_OPTFLAG_REQUIREDARG },
+
     /* C/C++ parser options. */
     { '\0', "-D",           OPTID_CXX('D'), CMDLINE_OPTFLAG_COMPILERLIKE },
     { '\0', "-I",           OPTID_CXX('I'), CMDLINE_OPTFLAG_COMPILERLIKE },
@@ -116,7 +226,16 @@ static const CMDLINE_OPTION cmdline_options[] = {
     /* JSON generator options. */
     { '\0', "json",         OPTID_JSON('J'), CMDLINE_OPTFLAG_OPTIONALARG },
 
+    /* Snapshot generator options. */
+    { '\0', "snapshot",     OPTID_SNAPSHOT('S'), CMDLINE_OPTFLAG_OPTIONALARG },
+
     /* Auxiliary options. */
+    { 'j',  "jobs",         'j', CMDLINE_OPTFLAG_REQUIREDARG },
+    { '\0', "cache-dir",    'C', CMDLINE_OPTFLAG_REQUIREDARG },
+    { '\0', "cache-url",    'U', CMDLINE_OPTFLAG_REQUIREDARG },
+    { '\0', "cache-size",   'Z', CMDLINE_OPTFLAG_REQUIREDARG },
+    { '\0', "explain",      'E', CMDLINE_OPTFLAG_OPTIONALARG },
+    { '\0', "parse-history", 'P', CMDLINE_OPTFLAG_REQUIREDARG },
     { 'n',  "dry-run",      'n', 0 },
     { 'h',  "help",         'h', 0 },
     { '\0', "version",      'V', 0 },
@@ -130,6 +249,31 @@ static int
 cmdline_callback(int id, const char* arg, void* userdata)
 {
     switch(id) {
+        /* Input options. */
+        case OPTID_INPUT('F'):
+            CHECK(array_append(&files_from_lists, (void*) arg) == 0);
+            break;
+        case OPTID_INPUT('0'):
+            files_from_null = 1;
+            break;
+        case OPTID_INPUT('J'):
+            from_json_file = arg;
+            break;
+        case OPTID_INPUT('M'):
+            from_snapshot_file = arg;
+            break;
+        case OPTID_INPUT('S'):
+        {
+            unsigned i, n;
+            char dummy;
+
+            if(sscanf(arg, "%u/%u%c", &i, &n, &dummy) != 2  ||  i < 1  ||  i > n)
+                FATAL(_("Invalid shard specification '%s' (expected I/N, with 1 <= I <= N)."), arg);
+            shard_index = i - 1;
+            shard_count = n;
+            break;
+        }
+
         /* C/C++ parser options. */
         case OPTID_CXX('I'):
             CHECK(array_append(&clang_opts, (void*) "-I") == 0);
@@ -161,7 +305,36 @@ cmdline_callback(int id, const char* arg, void* userdata)
                 json_output_file = (const char*) arg;
             break;
 
+        /* Snapshot generator options. */
+        case OPTID_SNAPSHOT('S'):
+            enabled_generators |= SNAPSHOT_GENERATOR;
+            if(arg != NULL)
+                snapshot_output_file = (const char*) arg;
+            break;
+
         /* Auxiliary options. */
+        case 'j':       n_jobs = atoi(arg); break;
+        case 'C':       cache_dir = arg; break;
+        case 'U':       cache_url = arg; break;
+        case 'Z':
+        {
+            unsigned long long n;
+            char suffix = '\0';
+            char dummy;
+
+            if(sscanf(arg, "%llu%c%c", &n, &suffix, &dummy) < 1  ||
+               (suffix != '\0'  &&  strchr("KkMmGg", suffix) == NULL))
+                FATAL(_("Invalid cache size '%s'."), arg);
+            switch(suffix) {
+                case 'G': case 'g':     n *= 1024;  /* Pass through. */
+                case 'M': case 'm':     n *= 1024;  /* Pass through. */
+                case 'K': case 'k':     n *= 1024;  break;
+            }
+            cache_size = (uint64_t) n;
+            break;
+        }
+        case 'E':       explain = 1; explain_file = arg; break;
+        case 'P':       parse_history_file = arg; break;
         case 'n':       dry_run = 1; break;
         case 'v':       verbose_level = (arg != NULL ? atoi(arg) : verbose_level+1); break;
         case 'h':       print_usage(); break;
@@ -182,32 +355,145 @@ cmdline_callback(int id, const char* arg, void* userdata)
     return 0;
 }
 
+static int
+input_id_cmp(const void* item, const void* key)
+{
+    const INPUT_ID* id1 = (const INPUT_ID*) item;
+    const INPUT_ID* id2 = (const INPUT_ID*) key;
+
+    if(id2->canon_path != NULL)
+        return (id1->canon_path != NULL ? strcmp(id1->canon_path, id2->canon_path) : -1);
+    return (id1->canon_path == NULL  &&  id1->dev == id2->dev  &&  id1->ino == id2->ino) ? 0 : -1;
+}
+
+/* If the input has already been accepted (possibly under another path),
+ * return the path under which we have seen it. Otherwise remember it and
+ * return NULL. */
+static const char*
+input_seen_as(const char* path, const struct stat* s)
+{
+    char canon_path[PATH_MAX];
+    INPUT_ID key;
+    INPUT_ID* id;
+    size_t path_len;
+    size_t canon_path_len = 0;
+    uint64_t hash;
+
+    key.dev = s->st_dev;
+    key.ino = s->st_ino;
+    if(key.ino != 0) {
+        key.canon_path = NULL;
+        hash = fnv1a_64(FNV1A_BASE_64, &key.dev, sizeof(dev_t));
+        hash = fnv1a_64(hash, &key.ino, sizeof(ino_t));
+    } else {
+        /* Some platforms (Windows) and file systems provide no inode numbers.
+         * Fall back to the canonical path. */
+        if(path_canonical(path, canon_path) != 0)
+            snprintf(canon_path, PATH_MAX, "%s", path);
+        key.canon_path = canon_path;
+        canon_path_len = strlen(canon_path);
+        hash = fnv1a_64(FNV1A_BASE_64, canon_path, canon_path_len);
+    }
+
+    id = (INPUT_ID*) htable_lookup(&input_ids, hash, input_id_cmp, &key);
+    if(id != NULL)
+        return id->path;
+
+    path_len = strlen(path);
+    id = (INPUT_ID*) malloc(sizeof(INPUT_ID) + path_len + canon_path_len + 1);
+    CHECK(id != NULL);
+    id->dev = key.dev;
+    id->ino = key.ino;
+    memcpy(id->path, path, path_len + 1);
+    if(key.canon_path != NULL) {
+        id->canon_path = id->path + path_len + 1;
+        memcpy(id->canon_path, canon_path, canon_path_len + 1);
+    } else {
+        id->canon_path = NULL;
+    }
+    CHECK(htable_insert(&input_ids, hash, id) == 0);
+    return NULL;
+}
+
+/* Sharding is based on the normalized path so that e.g. "./foo/bar.h" and
+ * "foo/bar.h" fall into the same shard, and it does not depend on anything
+ * else, so all the machines agree on the assignment. */
+static int
+input_in_shard(const char* path)
+{
+    char norm_path[PATH_MAX];
+    uint64_t hash;
+
+    if(shard_count == 0)
+        return 1;
+
+    if(path_normalize(path, norm_path) != 0)
+        FATAL(_("Path too long (%s)."), path);
+    hash = fnv1a_64(FNV1A_BASE_64, norm_path, strlen(norm_path));
+    return (hash % shard_count == shard_index);
+}
+
 static void
-process_input_file(const char* path, VALUE* store)
+process_input_file(const char* path, const struct stat* s)
 {
     const char* ext;
+    const char* seen_as;
+    PARSE_JOB* job;
+    uint64_t cost;
+    size_t path_len;
+    size_t depth;
 
     ext = path_extension(path);
-    if(strcmp(ext, ".h") == 0) {
-        NOTE(0, _("Parsing file %s as C/C++..."), path);
-        parse_cxx(path, array_data(&clang_opts), store);
-    } else {
+    if(strcmp(ext, ".h") != 0) {
         NOTE(1, _("Skipping file %s (unknown file type)."), path);
         return;
     }
 
+    seen_as = input_seen_as(path, s);
+    if(seen_as != NULL) {
+        NOTE(1, _("Skipping file %s (same file as %s)."), path, seen_as);
+        return;
+    }
+
+    if(!input_in_shard(path)) {
+        NOTE(2, _("Skipping file %s (not in shard %u/%u)."), path, shard_index+1, shard_count);
+        n_other_shard_files++;
+        return;
+    }
+
+    path_len = strlen(path);
+    job = (PARSE_JOB*) malloc(sizeof(PARSE_JOB) + path_len);
+    CHECK(job != NULL);
+    job->st = *s;
+    memcpy(job->path, path, path_len + 1);
+
+    /* Get the cached results on the way while the job waits in the queue. */
+    if(use_cache)
+        cache_prefetch(path, s);
+
+    cost = history_predict(path, (uint64_t) s->st_size);
+    depth = work_queue_push(&parse_queue, job, cost);
+    NOTE(2, _("Queued file %s (predicted cost: %llu us, queue depth: %u)."),
+            path, (unsigned long long) cost, (unsigned) depth);
     n_processed_files++;
 }
 
-static void process_input_path(const char* path, VALUE* store);
+static void process_input_path(const char* path);
 
 static void
-process_input_dir(const char* path, VALUE* store)
+process_input_dir(const char* path, const struct stat* s)
 {
     char buffer[PATH_MAX];
     char dir_item[PATH_MAX];
+    const char* seen_as;
     PATH_DIR* d;
 
+    seen_as = input_seen_as(path, s);
+    if(seen_as != NULL) {
+        NOTE(1, _("Skipping directory %s (same directory as %s)."), path, seen_as);
+        return;
+    }
+
     d = path_opendir(path);
     if(d == NULL)
         FATAL("%s (%s)", strerror(errno), path);
@@ -219,39 +505,274 @@ process_input_dir(const char* path, VALUE* store)
             continue;
 
         snprintf(buffer, PATH_MAX, "%s/%s", path, dir_item);
-        process_input_path(buffer, store);
+        process_input_path(buffer);
     }
 
     path_closedir(d);
 }
 
 static void
-process_input_path(const char* path, VALUE* store)
+process_input_path(const char* path)
 {
-    if(path_is_dir(path))
-        process_input_dir(path, store);
+    struct stat s;
+
+    if(stat(path, &s) != 0) {
+        WARN("%s (%s)", strerror(errno), path);
+        return;
+    }
+
+    if(S_ISDIR(s.st_mode))
+        process_input_dir(path, &s);
     else
-        process_input_file(path, store);
+        process_input_file(path, &s);
+}
+
+/* Read the list of paths from the given file (or from stdin if the list_path
+ * is "-") and process each of them as soon as it is read. Hence, for a long
+ * list produced by a slow pipe, we can make a progress before the producer
+ * finishes. */
+static void
+process_files_from(const char* list_path)
+{
+    char path[PATH_MAX];
+    size_t len = 0;
+    int delim = (files_from_null ? '\0' : '\n');
+    FILE* f;
+    int c;
+
+    if(strcmp(list_path, "-") == 0) {
+        f = stdin;
+    } else {
+        f = fopen(list_path, "rb");
+        if(f == NULL)
+            FATAL("%s (%s)", strerror(errno), list_path);
+    }
+
+    while(1) {
+        c = getc(f);
+
+        if(c == EOF  ||  c == delim) {
+            /* Tolerate lists with DOS line endings. */
+            if(!files_from_null  &&  len > 0  &&  path[len-1] == '\r')
+                len--;
+
+            if(len > 0) {
+                path[len] = '\0';
+                process_input_path(path);
+                len = 0;
+            }
+
+            if(c == EOF)
+                break;
+            continue;
+        }
+
+        if(len >= PATH_MAX-1) {
+            path[len] = '\0';
+            FATAL(_("Path too long in %s (%s...)."), list_path, path);
+        }
+        path[len++] = (char) c;
+    }
+
+    if(ferror(f))
+        FATAL("%s (%s)", strerror(errno), list_path);
+    if(f != stdin)
+        fclose(f);
+}
+
+static void
+parse_worker(void* arg)
+{
+    STORE* store = (STORE*) arg;
+    STORE part;
+    PARSE_JOB* job;
+    ARRAY deps = ARRAY_INITIALIZER;
+    CACHE_EXPLAIN cache_explain;
+    int cache_status;
+    int err;
+    uint64_t t0, t1;
+
+    while((job = (PARSE_JOB*) work_queue_pop(&parse_queue)) != NULL) {
+        /* Parse into a store of its own, as that is what gets cached. */
+        store_init(&part);
+        t0 = clock_usec();
+
+        if(use_cache) {
+            cache_status = cache_lookup(job->path, &job->st, &part, &cache_explain);
+        } else {
+            cache_status = CACHE_FAIL;
+            snprintf(cache_explain.reason, sizeof(cache_explain.reason), "%s", _("caching is disabled"));
+        }
+
+        if(cache_status == CACHE_HIT) {
+            NOTE(1, _("Using cached results for file %s."), job->path);
+            explain_input(job->path, "hit", &cache_explain, clock_usec() - t0);
+        } else {
+            if(explain  &&  explain_file == NULL)
+                print_diag(stdout, NULL, _("Re-parsing %s: %s."), job->path, cache_explain.reason);
+            NOTE(0, _("Parsing file %s as C/C++..."), job->path);
+            t1 = clock_usec();
+            if(cache_status == CACHE_MISS) {
+                err = parse_cxx(job->path, array_data(&clang_opts), &part, &deps);
+                if(err == 0)
+                    cache_save(cache_explain.key, &part, &deps);
+                array_clear(&deps, free);
+            } else {
+                err = parse_cxx(job->path, array_data(&clang_opts), &part, NULL);
+            }
+            history_record(job->path, (uint64_t) job->st.st_size, clock_usec() - t1);
+            explain_input(job->path, (err == 0 ? "parsed" : "failed"),
+                          (use_cache ? &cache_explain : NULL), clock_usec() - t0);
+        }
+
+        store_merge(store, &part);
+        store_fini(&part);
+        free(job);
+    }
+
+    array_fini(&deps, NULL);
+}
+
+static void
+start_parse_workers(void)
+{
+    int i;
+
+    if(n_jobs <= 0)
+        n_jobs = thread_cpu_count();
+
+    work_queue_init(&parse_queue, PARSE_QUEUE_CAPACITY);
+
+    parse_workers = (THREAD*) malloc(n_jobs * sizeof(THREAD));
+    worker_stores = (STORE*) malloc(n_jobs * sizeof(STORE));
+    CHECK(parse_workers != NULL  &&  worker_stores != NULL);
+    for(i = 0; i < n_jobs; i++) {
+        store_init(&worker_stores[i]);
+        thread_create(&parse_workers[i], parse_worker, &worker_stores[i]);
+    }
 }
 
 static void
-generate_output(const VALUE* store)
+finish_parse_workers(STORE* store)
 {
+    uint64_t t0;
+    int i;
+
+    work_queue_close(&parse_queue);
+    for(i = 0; i < n_jobs; i++)
+        thread_join(&parse_workers[i]);
+    free(parse_workers);
+
+    /* Which worker has parsed what is a matter of scheduling, but the merge
+     * resolves conflicts in a way which does not depend on the order. */
+    t0 = clock_usec();
+    for(i = 0; i < n_jobs; i++) {
+        store_merge(store, &worker_stores[i]);
+        store_fini(&worker_stores[i]);
+    }
+    free(worker_stores);
+    NOTE(1, _("Merged results of %d workers in %u ms."), n_jobs,
+              (unsigned) ((clock_usec() - t0) / 1000));
+
+    NOTE(1, _("Parse queue: maximal depth %u (capacity %u), walker waited %u times, "
+              "workers waited %u times (%d workers)."),
+              (unsigned) parse_queue.max_count, (unsigned) parse_queue.capacity,
+              parse_queue.n_push_waits, parse_queue.n_pop_waits, n_jobs);
+
+    work_queue_fini(&parse_queue);
+}
+
+static void
+generate_output(const STORE* store)
+{
+    VALUE root = VALUE_NULL_INITIALIZER;
+
     if(dry_run)
         return;
 
     if(enabled_generators & HTML_GENERATOR)
         gen_html(html_output_dir, html_skin, store);
 
+    /* These work with the VALUE tree of the store. */
+    if(enabled_generators & (JSON_GENERATOR | SNAPSHOT_GENERATOR))
+        store_export(store, &root);
+
+    if(enabled_generators & JSON_GENERATOR)
+        gen_json(json_output_file, &root);
+
+    if(enabled_generators & SNAPSHOT_GENERATOR) {
+        if(snapshot_write(&root, snapshot_output_file) != 0)
+            exit(EXIT_FAILURE);
+    }
+
+    value_fini(&root);
+    output_report();
+}
+
+static void
+generate_output_from_snapshot(const SNAPSHOT* snap)
+{
+    if(dry_run)
+        return;
+
+    if(enabled_generators & HTML_GENERATOR)
+        gen_html_snapshot(html_output_dir, html_skin, snap);
+
     if(enabled_generators & JSON_GENERATOR)
-        gen_json(json_output_file, store);
+        gen_json_snapshot(json_output_file, snap);
+
+    output_report();
+}
+
+static void
+parse_input_files(STORE* store)
+{
+    size_t i;
+
+    if(parse_history_file != NULL)
+        history_load(parse_history_file);
+    use_cache = (cache_dir != NULL  ||  cache_url != NULL);
+    if(use_cache)
+        cache_init(cache_dir, cache_url, parse_cxx_options_hash(FNV1A_BASE_64, array_data(&clang_opts)), cache_size);
+
+    start_parse_workers();
+    for(i = 0; i < array_size(&argv_paths); i++)
+        process_input_path(array_get(&argv_paths, i));
+    for(i = 0; i < array_size(&files_from_lists); i++)
+        process_files_from(array_get(&files_from_lists, i));
+    finish_parse_workers(store);
+
+    if(use_cache)
+        cache_fini();
+    if(parse_history_file != NULL)
+        history_save(parse_history_file);
+    history_fini();
+
+    if(n_processed_files + n_other_shard_files == 0)
+        FATAL(_("No files to process."));
+}
+
+static void
+merge_partial_stores(STORE* store)
+{
+    size_t i;
+    const char* path;
+
+    if(array_size(&argv_paths) == 0)
+        FATAL(_("No partial stores to merge."));
+
+    for(i = 0; i < array_size(&argv_paths); i++) {
+        path = array_get(&argv_paths, i);
+        NOTE(0, _("Merging partial store %s..."), path);
+        if(store_load_json(store, path) != 0)
+            exit(EXIT_FAILURE);
+    }
 }
 
 int
 main(int argc, char** argv)
 {
-    size_t i;
-    VALUE store = VALUE_NULL_INITIALIZER;
+    STORE store;
 
 #ifdef ENABLE_I18N
     setlocale(LC_ALL, "");
@@ -262,22 +783,92 @@ main(int argc, char** argv)
     argv0 = argv[0];
     path_init(argv0);
 
+    /* Sub-command? */
+    if(argc > 1  &&  strcmp(argv[1], "merge") == 0) {
+        merge_mode = 1;
+        argc--;
+        argv++;
+    } else if(argc > 1  &&  strcmp(argv[1], "cache") == 0) {
+        if(argc < 3  ||  (strcmp(argv[2], "stats") != 0  &&  strcmp(argv[2], "prune") != 0))
+            FATAL(_("The cache command expects 'stats' or 'prune'."));
+        cache_command = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
     cmdline_read(cmdline_options, argc, argv, cmdline_callback, NULL);
     array_append(&clang_opts, NULL);
+
+    if(cache_command != NULL) {
+        if(cache_dir == NULL)
+            FATAL(_("The cache command requires --cache-dir."));
+        if(strcmp(cache_command, "stats") == 0)
+            cache_print_stats(cache_dir);
+        else if(cache_size > 0)
+            cache_prune(cache_dir, cache_size);
+        path_fini();
+        return EXIT_SUCCESS;
+    }
+
+    if(merge_mode  &&  (shard_count > 0  ||  array_size(&files_from_lists) > 0))
+        FATAL(_("Options --shard and --files-from cannot be used with the merge command."));
+    if(from_json_file != NULL  &&  (merge_mode  ||  shard_count > 0  ||  from_snapshot_file != NULL  ||
+            array_size(&files_from_lists) > 0  ||  array_size(&argv_paths) > 0))
+        FATAL(_("Option --from-json cannot be used with any other input."));
+    if(from_snapshot_file != NULL  &&  (merge_mode  ||  shard_count > 0  ||
+            array_size(&files_from_lists) > 0  ||  array_size(&argv_paths) > 0))
+        FATAL(_("Option --from-snapshot cannot be used with any other input."));
+    if(from_snapshot_file != NULL  &&  (enabled_generators & SNAPSHOT_GENERATOR))
+        FATAL(_("Option --snapshot cannot be used with --from-snapshot."));
+
+    if(shard_count > 0) {
+        /* The partial store is just an output of the JSON generator. Other
+         * generators would see only a part of the data. */
+        if(enabled_generators & HTML_GENERATOR)
+            WARN(_("HTML generator is disabled with --shard; run the merge command instead."));
+        enabled_generators = JSON_GENERATOR;
+    }
     if(enabled_generators == 0)
         enabled_generators = HTML_GENERATOR;
 
+    if(explain_file != NULL)
+        explain_open(explain_file);
+
+    /* Render directly from the snapshot; no store is needed at all. */
+    if(from_snapshot_file != NULL) {
+        SNAPSHOT snap;
+
+        NOTE(0, _("Mapping snapshot %s..."), from_snapshot_file);
+        if(snapshot_open(&snap, from_snapshot_file) != 0)
+            exit(EXIT_FAILURE);
+        generate_output_from_snapshot(&snap);
+        snapshot_close(&snap);
+
+        explain_close();
+        path_fini();
+        return EXIT_SUCCESS;
+    }
+
     /* Create main data store. */
     store_init(&store);
 
-    /* Process input files. */
-    for(i = 0; i < array_size(&argv_paths); i++)
-        process_input_path(array_get(&argv_paths, i), &store);
-
-    if(n_processed_files == 0)
-        FATAL(_("No files to process."));
+    /* Fill the store. */
+    if(from_json_file != NULL) {
+        NOTE(0, _("Loading store %s..."), from_json_file);
+        if(store_load_json(&store, from_json_file) != 0)
+            exit(EXIT_FAILURE);
+    } else if(merge_mode) {
+        merge_partial_stores(&store);
+    } else {
+        parse_input_files(&store);
+    }
+    store_link(&store);
+    store_report(&store);
+    store_freeze(&store);
 
     array_fini(&argv_paths, NULL);
+    array_fini(&files_from_lists, NULL);
+    htable_fini(&input_ids, free);
     array_fini(&clang_opts, NULL);
 
     /* Generate output. */
@@ -286,5 +877,7 @@ main(int argc, char** argv)
     /* Release data store. */
     store_fini(&store);
 
+    explain_close();
+    path_fini();
     return EXIT_SUCCESS;
 }
@@ -26,12 +26,45 @@
 #include "misc.h"
 #include <stdarg.h>
 
+#ifndef _WIN32
+    #include <time.h>
+#endif
+
+
+uint64_t
+clock_usec(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq = { 0 };
+    LARGE_INTEGER now;
+
+    if(freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t) (now.QuadPart / freq.QuadPart) * 1000000 +
+           (uint64_t) (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+#endif
+}
+
 
 void
 print_diag(FILE* out, const char* prefix, const char* fmt, ...)
 {
     va_list args;
 
+    /* Messages may come from multiple threads. Make sure they do not get
+     * interleaved. */
+#ifdef _WIN32
+    _lock_file(out);
+#else
+    flockfile(out);
+#endif
+
     if(prefix != NULL)
         fprintf(out, "%s", prefix);
 
@@ -40,4 +73,10 @@ print_diag(FILE* out, const char* prefix, const char* fmt, ...)
     va_end(args);
 
     fprintf(out, "\n");
+
+#ifdef _WIN32
+    _unlock_file(out);
+#else
+    funlockfile(out);
+#endif
 }
@@ -72,6 +72,11 @@ extern int verbose_level;
 #endif
 
 
+/* Monotonic clock (in microseconds) for measuring durations. */
+
+uint64_t clock_usec(void);
+
+
 /* Log message output. */
 
 void print_diag(FILE* out, const char* prefix, const char* fmt, ...)
@@ -0,0 +1,364 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "output.h"
+#include "explain.h"
+#include "fnv1a.h"
+#include "path_util.h"
+
+
+#define OUTPUT_MANIFEST_NAME    ".docbaker-manifest"
+
+
+static unsigned output_n_written = 0;
+static unsigned output_n_skipped = 0;
+static unsigned output_n_up_to_date = 0;   /* Not even rendered. */
+static unsigned output_n_deleted = 0;
+
+
+/* Check whether the file exists and has exactly the given contents. The size
+ * is compared first, so in the common case of a changed file we do not have
+ * to read it at all. */
+static int
+output_is_same(const char* path, const void* data, size_t size)
+{
+    char buffer[64 * 1024];
+    struct stat st;
+    size_t off = 0;
+    size_t n;
+    FILE* f;
+    int is_same = 0;
+
+    if(stat(path, &st) != 0  ||  !S_ISREG(st.st_mode)  ||  (uint64_t) st.st_size != (uint64_t) size)
+        return 0;
+
+    f = fopen(path, "rb");
+    if(f == NULL)
+        return 0;
+    while(off < size) {
+        n = fread(buffer, 1, sizeof(buffer), f);
+        if(n == 0  ||  n > size - off  ||  memcmp(buffer, (const char*) data + off, n) != 0)
+            break;
+        off += n;
+    }
+    if(off == size  &&  fread(buffer, 1, 1, f) == 0)
+        is_same = 1;
+    fclose(f);
+
+    return is_same;
+}
+
+/* Returns 1 if the file has been written, 0 if it has been left intact. */
+static int
+output_write_if_changed(const char* path, const void* data, size_t size)
+{
+    char tmp_path[PATH_MAX];
+    FILE* f;
+    int err = 0;
+
+    if(output_is_same(path, data, size))
+        return 0;
+
+    /* Write into a temporary file and rename it only when complete, so
+     * whoever serves the output never sees a partially written file. */
+    f = path_create_temp(path, "wb", tmp_path);
+    if(f == NULL)
+        FATAL("%s (%s)", strerror(errno), path);
+    if(fwrite(data, 1, size, f) != size)
+        err = -1;
+    if(fclose(f) != 0)
+        err = -1;
+    if(err != 0  ||  path_rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        FATAL(_("Failed to write %s."), path);
+    }
+
+    return 1;
+}
+
+static void
+output_write(const char* path, const void* data, size_t size,
+             const char* changed, const uint64_t* deps_hash, uint64_t t0)
+{
+    if(output_write_if_changed(path, data, size)) {
+        NOTE(2, _("Writing %s."), path);
+        output_n_written++;
+        explain_output(path, "written", changed, deps_hash, clock_usec() - t0);
+    } else {
+        NOTE(2, _("Skipping %s (unchanged)."), path);
+        output_n_skipped++;
+        explain_output(path, "unchanged", changed, deps_hash, clock_usec() - t0);
+    }
+}
+
+void
+output_write_file(const char* path, const void* data, size_t size)
+{
+    output_write(path, data, size, NULL, NULL, clock_usec());
+}
+
+
+typedef struct OUTPUT_ENTRY {
+    uint64_t deps_hash;
+    char name[1];
+} OUTPUT_ENTRY;
+
+
+static OUTPUT_ENTRY*
+output_entry_new(const char* name, uint64_t deps_hash)
+{
+    OUTPUT_ENTRY* entry;
+    size_t len = strlen(name);
+
+    entry = (OUTPUT_ENTRY*) malloc(sizeof(OUTPUT_ENTRY) + len);
+    CHECK(entry != NULL);
+    entry->deps_hash = deps_hash;
+    memcpy(entry->name, name, len + 1);
+    return entry;
+}
+
+static uint64_t
+output_name_hash(const char* name)
+{
+    return fnv1a_64(FNV1A_BASE_64, name, strlen(name));
+}
+
+static int
+output_entry_cmp(const void* item, const void* key)
+{
+    return strcmp(((const OUTPUT_ENTRY*) item)->name, (const char*) key);
+}
+
+static int
+output_name_is_sane(const char* name)
+{
+    /* Never let a (possibly tampered) manifest make us delete anything
+     * outside of the directory. */
+    return (name[0] != '\0'  &&  strcmp(name, ".") != 0  &&  strcmp(name, "..") != 0  &&
+            strchr(name, '/') == NULL  &&  strchr(name, '\\') == NULL  &&
+            strcmp(name, OUTPUT_MANIFEST_NAME) != 0);
+}
+
+static void
+output_dir_path(const OUTPUT_DIR* dir, const char* name, char buffer[PATH_MAX])
+{
+    if(snprintf(buffer, PATH_MAX, "%s/%s", dir->path, name) >= PATH_MAX)
+        FATAL(_("Path too long (%s/%s)."), dir->path, name);
+}
+
+static void
+output_dir_load_manifest(OUTPUT_DIR* dir)
+{
+    char path[PATH_MAX];
+    char line[PATH_MAX + 32];
+    OUTPUT_ENTRY* entry;
+    unsigned long long deps_hash;
+    int name_offset;
+    size_t len;
+    FILE* f;
+
+    output_dir_path(dir, OUTPUT_MANIFEST_NAME, path);
+    f = fopen(path, "r");
+    if(f == NULL) {
+        /* It is ok if the manifest does not exist yet. */
+        if(errno != ENOENT)
+            WARN("%s (%s)", strerror(errno), path);
+        return;
+    }
+
+    /* Each line is "<deps hash> <name>". */
+    while(fgets(line, sizeof(line), f) != NULL) {
+        len = strlen(line);
+        if(len > 0  &&  line[len-1] == '\n')
+            line[--len] = '\0';
+        if(sscanf(line, "%16llx %n", &deps_hash, &name_offset) != 1  ||
+           !output_name_is_sane(line + name_offset))
+        {
+            WARN(_("Ignoring malformed line in %s."), path);
+            continue;
+        }
+        if(htable_lookup(&dir->old_files, output_name_hash(line + name_offset),
+                         output_entry_cmp, line + name_offset) != NULL)
+            continue;
+
+        entry = output_entry_new(line + name_offset, deps_hash);
+        CHECK(htable_insert(&dir->old_files, output_name_hash(entry->name), entry) == 0);
+        CHECK(array_append(&dir->old_entries, entry) == 0);
+    }
+
+    fclose(f);
+}
+
+void
+output_dir_open(OUTPUT_DIR* dir, const char* path)
+{
+    if(mkdir(path, 0755) != 0) {
+        if(!path_is_dir(path))
+            FATAL("%s (%s)", strerror(errno), path);
+    }
+
+    dir->path = strdup(path);
+    CHECK(dir->path != NULL);
+    htable_init(&dir->old_files);
+    array_init(&dir->old_entries);
+    htable_init(&dir->new_files);
+    array_init(&dir->new_entries);
+    dir->changed = NULL;
+    dir->render_start = 0;
+
+    output_dir_load_manifest(dir);
+}
+
+static void
+output_dir_add_new(OUTPUT_DIR* dir, const char* name, uint64_t deps_hash)
+{
+    OUTPUT_ENTRY* entry;
+
+    entry = (OUTPUT_ENTRY*) htable_lookup(&dir->new_files, output_name_hash(name), output_entry_cmp, name);
+    if(entry != NULL) {
+        entry->deps_hash = deps_hash;
+        return;
+    }
+
+    entry = output_entry_new(name, deps_hash);
+    CHECK(htable_insert(&dir->new_files, output_name_hash(entry->name), entry) == 0);
+    CHECK(array_append(&dir->new_entries, entry) == 0);
+}
+
+int
+output_dir_is_up_to_date(OUTPUT_DIR* dir, const char* name, uint64_t deps_hash)
+{
+    char path[PATH_MAX];
+    OUTPUT_ENTRY* entry;
+    struct stat st;
+    uint64_t t0;
+
+    t0 = clock_usec();
+    dir->render_start = t0;
+
+    entry = (OUTPUT_ENTRY*) htable_lookup(&dir->old_files, output_name_hash(name), output_entry_cmp, name);
+    if(entry == NULL) {
+        dir->changed = "new";
+        return 0;
+    }
+    if(entry->deps_hash != deps_hash) {
+        dir->changed = "inputs";
+        return 0;
+    }
+
+    /* The user might have deleted or replaced it. */
+    output_dir_path(dir, name, path);
+    if(stat(path, &st) != 0  ||  !S_ISREG(st.st_mode)) {
+        dir->changed = "missing";
+        return 0;
+    }
+
+    NOTE(2, _("Skipping %s (inputs unchanged)."), path);
+    output_dir_add_new(dir, name, deps_hash);
+    output_n_up_to_date++;
+    explain_output(path, "up-to-date", NULL, &deps_hash, clock_usec() - t0);
+    return 1;
+}
+
+void
+output_dir_write(OUTPUT_DIR* dir, const char* name, uint64_t deps_hash,
+                 const void* data, size_t size)
+{
+    char path[PATH_MAX];
+
+    if(!output_name_is_sane(name))
+        FATAL(_("Invalid output file name '%s'."), name);
+
+    output_dir_add_new(dir, name, deps_hash);
+    output_dir_path(dir, name, path);
+
+    /* If the caller has asked output_dir_is_up_to_date() first, the page has
+     * been rendered since then. */
+    if(dir->changed == NULL)
+        dir->render_start = clock_usec();
+    output_write(path, data, size, dir->changed, &deps_hash, dir->render_start);
+    dir->changed = NULL;
+}
+
+static void
+output_dir_save_manifest(OUTPUT_DIR* dir)
+{
+    char path[PATH_MAX];
+    char hash[32];
+    BUFFER buf;
+    const OUTPUT_ENTRY* entry;
+    size_t i;
+
+    buffer_init(&buf);
+    for(i = 0; i < array_size(&dir->new_entries); i++) {
+        entry = array_get(&dir->new_entries, i);
+        snprintf(hash, sizeof(hash), "%016llx ", (unsigned long long) entry->deps_hash);
+        CHECK(buffer_append(&buf, hash, strlen(hash)) == 0);
+        CHECK(buffer_append(&buf, entry->name, strlen(entry->name)) == 0);
+        CHECK(buffer_append(&buf, "\n", 1) == 0);
+    }
+
+    output_dir_path(dir, OUTPUT_MANIFEST_NAME, path);
+    output_write_if_changed(path, buffer_data(&buf), buffer_size(&buf));
+    buffer_fini(&buf);
+}
+
+void
+output_dir_close(OUTPUT_DIR* dir)
+{
+    char path[PATH_MAX];
+    const OUTPUT_ENTRY* entry;
+    size_t i;
+
+    for(i = 0; i < array_size(&dir->old_entries); i++) {
+        entry = array_get(&dir->old_entries, i);
+        if(htable_lookup(&dir->new_files, output_name_hash(entry->name), output_entry_cmp, entry->name) != NULL)
+            continue;
+
+        output_dir_path(dir, entry->name, path);
+        if(remove(path) == 0) {
+            NOTE(2, _("Deleting stale %s."), path);
+            output_n_deleted++;
+            explain_output(path, "deleted", NULL, NULL, 0);
+        } else if(errno != ENOENT) {
+            WARN("%s (%s)", strerror(errno), path);
+        }
+    }
+
+    output_dir_save_manifest(dir);
+
+    htable_fini(&dir->old_files, NULL);
+    array_fini(&dir->old_entries, free);
+    htable_fini(&dir->new_files, NULL);
+    array_fini(&dir->new_entries, free);
+    free(dir->path);
+}
+
+void
+output_report(void)
+{
+    NOTE(0, _("Output: %u files written, %u unchanged, %u up to date, %u stale deleted."),
+            output_n_written, output_n_skipped, output_n_up_to_date, output_n_deleted);
+}
@@ -0,0 +1,91 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_OUTPUT_H
+#define DOCBAKER_OUTPUT_H
+
+#include "misc.h"
+#include "array.h"
+#include "htable.h"
+
+
+/* Writing of the generated files.
+ *
+ * Generators render each output file into memory and hand it over here. If
+ * the file already exists with exactly the same contents, it is left alone
+ * so its mtime does not change and tools like make(1) or rsync(1) do not see
+ * any work to do. Otherwise the file is (atomically) replaced.
+ *
+ * Output directories additionally remember which files they contain in a
+ * manifest, so files generated by a previous run but not by the current one
+ * (e.g. for a removed input file) can be deleted. Only files listed in the
+ * manifest are ever deleted; anything else the user puts into the directory
+ * is left intact.
+ *
+ * The manifest also records, for each file, a hash of all the inputs the
+ * file has been rendered from (as computed by the generator). If the hash
+ * has not changed since the previous run, the generator does not need to
+ * render the file at all.
+ */
+
+
+typedef struct OUTPUT_DIR {
+    char* path;
+    HTABLE old_files;       /* Files listed in the manifest of previous run. */
+    ARRAY old_entries;
+    HTABLE new_files;       /* Files produced (or kept) by this run. */
+    ARRAY new_entries;
+
+    /* Set by output_dir_is_up_to_date() for --explain. */
+    const char* changed;
+    uint64_t render_start;
+} OUTPUT_DIR;
+
+
+/* Write a standalone output file. */
+void output_write_file(const char* path, const void* data, size_t size);
+
+/* Create the directory (if needed) and load its manifest. */
+void output_dir_open(OUTPUT_DIR* dir, const char* path);
+
+/* Check whether the file has been generated by a previous run from the same
+ * inputs (as identified by deps_hash) and still exists. If yes, the file is
+ * kept as it is and non-zero is returned, so the caller can skip rendering
+ * it. Otherwise the caller is supposed to call output_dir_write(). */
+int output_dir_is_up_to_date(OUTPUT_DIR* dir, const char* name, uint64_t deps_hash);
+
+/* Write a file into the directory. The name must not contain any path
+ * separator. */
+void output_dir_write(OUTPUT_DIR* dir, const char* name, uint64_t deps_hash,
+                      const void* data, size_t size);
+
+/* Delete stale files and save the new manifest. */
+void output_dir_close(OUTPUT_DIR* dir);
+
+/* Print how many files have been written, skipped and deleted. */
+void output_report(void);
+
+
+#endif  /* DOCBAKER_OUTPUT_H */
@@ -25,41 +25,244 @@
 
 #include "parse_cxx.h"
 #include "array.h"
+#include "fnv1a.h"
 #include "path_util.h"
 #include "store.h"
 
 #include <clang-c/Index.h>
 
+#include <ctype.h>
+
 
 typedef struct PARSE_CXX_CONTEXT {
     ARRAY comments;
-    VALUE* store;
-    VALUE* val_file;
+    STORE* store;
+    STORE_ID file;
+    BUFFER long_name;
+    BUFFER refs;            /* CXString[] (USRs of referenced types) */
+    BUFFER ref_ptrs;        /* const char*[] */
 } PARSE_CXX_CONTEXT;
 
 
 #if 0
 static void
-parse_cxx_comment2doc(PARSE_CXX_CONTEXT* ctx, VALUE* val, const char* raw_comment_text)
+parse_cxx_comment2doc(PARSE_CXX_CONTEXT* ctx, STORE_ID symbol, const char* raw_comment_text)
 {
-    store_register_doc(val, raw_comment_text);
+    store_register_doc(ctx->store, symbol, raw_comment_text);
 }
 #endif
 
+/* Append all the enclosing scopes (namespaces, classes) of the entity,
+ * e.g. "ns::klass::". */
+static void
+parse_cxx_append_scope(BUFFER* buf, CXCursor cursor)
+{
+    CXCursor parent;
+    CXString spelling;
+    const char* str;
+
+    parent = clang_getCursorSemanticParent(cursor);
+    if(clang_Cursor_isNull(parent)  ||  parent.kind == CXCursor_TranslationUnit)
+        return;
+
+    parse_cxx_append_scope(buf, parent);
+    spelling = clang_getCursorSpelling(parent);
+    str = clang_getCString(spelling);
+    if(str == NULL  ||  str[0] == '\0')
+        str = "(anonymous)";
+    CHECK(buffer_append(buf, str, strlen(str)) == 0);
+    CHECK(buffer_append(buf, "::", 2) == 0);
+    clang_disposeString(spelling);
+}
+
+/* Fully qualified name of the entity, e.g. "ns::klass::method(int)" or
+ * "struct ns::foo". This is what identifies the entity in the store. */
+static const char*
+parse_cxx_long_name(PARSE_CXX_CONTEXT* ctx, CXCursor cursor, const char* prefix, const char* display_name)
+{
+    buffer_clear(&ctx->long_name);
+    CHECK(buffer_append(&ctx->long_name, prefix, strlen(prefix)) == 0);
+    parse_cxx_append_scope(&ctx->long_name, cursor);
+    CHECK(buffer_append(&ctx->long_name, display_name, strlen(display_name) + 1) == 0);
+    return (const char*) buffer_data(&ctx->long_name);
+}
+
+/* Prefix of long names of the types (or NULL if the cursor is no type). */
+static const char*
+parse_cxx_type_prefix(enum CXCursorKind kind)
+{
+    switch(kind) {
+        case CXCursor_StructDecl:   return "struct ";
+        case CXCursor_UnionDecl:    return "union ";
+        case CXCursor_EnumDecl:     return "enum ";
+        case CXCursor_ClassDecl:    return "class ";
+        case CXCursor_TypedefDecl:  return "typedef ";
+        default:                    return NULL;
+    }
+}
+
+/* Whether the function's declarator is followed by its body. We parse with
+ * CXTranslationUnit_SkipFunctionBodies so libclang never sees any body and
+ * clang_isCursorDefinition() is false for all functions. Hence we look at
+ * the source text right after the declarator: a body or a function-try-block
+ * means a definition. */
+static int
+parse_cxx_has_body(CXCursor cursor)
+{
+    CXFile file;
+    unsigned off;
+    size_t size;
+    const char* text;
+
+    clang_getSpellingLocation(clang_getRangeEnd(clang_getCursorExtent(cursor)),
+                &file, NULL, NULL, &off);
+    if(file == NULL)
+        return 0;
+    text = clang_getFileContents(clang_Cursor_getTranslationUnit(cursor), file, &size);
+    if(text == NULL)
+        return 0;
+
+    while(off < size) {
+        if(text[off] == ' '  ||  text[off] == '\t'  ||  text[off] == '\r'  ||  text[off] == '\n') {
+            off++;
+        } else if(off + 1 < size  &&  text[off] == '/'  &&  text[off+1] == '/') {
+            while(off < size  &&  text[off] != '\n')
+                off++;
+        } else if(off + 1 < size  &&  text[off] == '/'  &&  text[off+1] == '*') {
+            off += 2;
+            while(off + 1 < size  &&  !(text[off] == '*'  &&  text[off+1] == '/'))
+                off++;
+            off += 2;
+        } else {
+            break;
+        }
+    }
+
+    if(off >= size)
+        return 0;
+    if(text[off] == '{')
+        return 1;
+    if(off + 3 <= size  &&  strncmp(text + off, "try", 3) == 0  &&
+       (off + 3 == size  ||  !(isalnum((unsigned char) text[off+3])  ||  text[off+3] == '_')))
+        return 1;
+    return 0;
+}
+
+/* Register all the attributes of the symbol `id` we can get from its
+ * cursor. */
+static void
+parse_cxx_attrs(PARSE_CXX_CONTEXT* ctx, STORE_ID id, CXCursor cursor)
+{
+    CXString usr;
+    CXCursor parent;
+    CXString spelling;
+    const char* prefix;
+    unsigned line, column;
+
+    usr = clang_getCursorUSR(cursor);
+    store_register_usr(ctx->store, id, clang_getCString(usr));
+    clang_disposeString(usr);
+
+    clang_getSpellingLocation(clang_getCursorLocation(cursor), NULL, &line, &column, NULL);
+    store_register_location(ctx->store, id, line, column);
+
+    if(clang_isCursorDefinition(cursor)  ||  (cursor.kind == CXCursor_FunctionDecl  &&  parse_cxx_has_body(cursor)))
+        store_register_flags(ctx->store, id, STORE_FLAG_DEFINITION);
+
+    /* The enclosing struct (if any) has been registered before we have
+     * recursed into it. */
+    parent = clang_getCursorSemanticParent(cursor);
+    prefix = parse_cxx_type_prefix(parent.kind);
+    if(prefix != NULL) {
+        spelling = clang_getCursorSpelling(parent);
+        store_register_parent(ctx->store, id, store_lookup_symbol(ctx->store,
+                    parse_cxx_long_name(ctx, parent, prefix, clang_getCString(spelling))));
+        clang_disposeString(spelling);
+    }
+}
+
+/* Remember the USR of the type's declaration (if it has any), looking
+ * through pointers, references and arrays. */
+static void
+parse_cxx_add_ref(PARSE_CXX_CONTEXT* ctx, CXType type)
+{
+    const CXString* refs = (const CXString*) buffer_data(&ctx->refs);
+    size_t i, n = buffer_size(&ctx->refs) / sizeof(CXString);
+    CXType inner;
+    CXCursor decl;
+    CXString usr;
+    const char* str;
+
+    while(1) {
+        inner = clang_getPointeeType(type);
+        if(inner.kind == CXType_Invalid)
+            inner = clang_getElementType(type);
+        if(inner.kind == CXType_Invalid)
+            break;
+        type = inner;
+    }
+
+    decl = clang_getTypeDeclaration(type);
+    if(!clang_isDeclaration(decl.kind))
+        return;
+
+    usr = clang_getCursorUSR(decl);
+    str = clang_getCString(usr);
+    if(str == NULL  ||  str[0] == '\0')
+        goto skip;
+    for(i = 0; i < n; i++) {
+        if(strcmp(clang_getCString(refs[i]), str) == 0)
+            goto skip;
+    }
+    CHECK(buffer_append(&ctx->refs, &usr, sizeof(CXString)) == 0);
+    return;
+
+skip:
+    clang_disposeString(usr);
+}
+
+static void
+parse_cxx_flush_refs(PARSE_CXX_CONTEXT* ctx, STORE_ID id)
+{
+    const CXString* refs = (const CXString*) buffer_data(&ctx->refs);
+    size_t i, n = buffer_size(&ctx->refs) / sizeof(CXString);
+    const char* str;
+
+    buffer_clear(&ctx->ref_ptrs);
+    for(i = 0; i < n; i++) {
+        str = clang_getCString(refs[i]);
+        CHECK(buffer_append(&ctx->ref_ptrs, &str, sizeof(const char*)) == 0);
+    }
+    store_register_refs(ctx->store, id, (const char**) buffer_data(&ctx->ref_ptrs), (unsigned) n);
+
+    for(i = 0; i < n; i++)
+        clang_disposeString(refs[i]);
+    buffer_clear(&ctx->refs);
+}
+
 static void
 parse_cxx_function(PARSE_CXX_CONTEXT* ctx, CXCursor cursor)
 {
     CXString name;
     CXString spelling;
     CXString comment;
+    STORE_ID id;
+    int i, n;
 
     name = clang_getCursorDisplayName(cursor);
     spelling = clang_getCursorSpelling(cursor);
     comment = clang_Cursor_getRawCommentText(cursor);
 
     NOTE(1, "Detected function %s.", clang_getCString(spelling));
-    store_register_function(ctx->store, ctx->val_file,
-                    clang_getCString(spelling), clang_getCString(name));
+    id = store_register_function(ctx->store, ctx->file, clang_getCString(spelling),
+                    parse_cxx_long_name(ctx, cursor, "", clang_getCString(name)));
+    parse_cxx_attrs(ctx, id, cursor);
+
+    parse_cxx_add_ref(ctx, clang_getCursorResultType(cursor));
+    n = clang_Cursor_getNumArguments(cursor);
+    for(i = 0; i < n; i++)
+        parse_cxx_add_ref(ctx, clang_getCursorType(clang_Cursor_getArgument(cursor, i)));
+    parse_cxx_flush_refs(ctx, id);
 
     //parse_cxx_comment2doc(ctx, val_func, clang_getCString(comment));
 
@@ -88,6 +291,34 @@ parse_cxx_function(PARSE_CXX_CONTEXT* ctx, CXCursor cursor)
     clang_disposeString(comment);
 }
 
+static void
+parse_cxx_type(PARSE_CXX_CONTEXT* ctx, CXCursor cursor)
+{
+    CXString spelling;
+    const char* prefix = parse_cxx_type_prefix(cursor.kind);
+    STORE_ID id;
+
+    /* Forward declarations are not interesting and anonymous types are
+     * documented through the typedef (if any). */
+    if(cursor.kind != CXCursor_TypedefDecl  &&  !clang_isCursorDefinition(cursor))
+        return;
+    if(clang_Cursor_isAnonymous(cursor))
+        return;
+
+    spelling = clang_getCursorSpelling(cursor);
+    NOTE(1, "Detected type %s.", clang_getCString(spelling));
+    id = store_register_type(ctx->store, ctx->file, clang_getCString(spelling),
+                    parse_cxx_long_name(ctx, cursor, prefix, clang_getCString(spelling)));
+    parse_cxx_attrs(ctx, id, cursor);
+
+    if(cursor.kind == CXCursor_TypedefDecl) {
+        parse_cxx_add_ref(ctx, clang_getTypedefDeclUnderlyingType(cursor));
+        parse_cxx_flush_refs(ctx, id);
+    }
+
+    clang_disposeString(spelling);
+}
+
 static void
 parse_cxx_macro(PARSE_CXX_CONTEXT* ctx, CXCursor cur)
 {
@@ -115,6 +346,12 @@ parse_cxx_callback(CXCursor cur, CXCursor parent_cur, CXClientData data)
 
     switch(cur.kind) {
         case CXCursor_FunctionDecl:     parse_cxx_function(ctx, cur); break;
+        case CXCursor_StructDecl:
+        case CXCursor_UnionDecl:
+        case CXCursor_ClassDecl:        parse_cxx_type(ctx, cur); return CXChildVisit_Recurse;
+        case CXCursor_EnumDecl:
+        case CXCursor_TypedefDecl:      parse_cxx_type(ctx, cur); break;
+        case CXCursor_Namespace:        return CXChildVisit_Recurse;
         case CXCursor_MacroDefinition:  parse_cxx_macro(ctx, cur); break;
         default:                        break;
     }
@@ -122,23 +359,32 @@ parse_cxx_callback(CXCursor cur, CXCursor parent_cur, CXClientData data)
     return CXChildVisit_Continue;
 }
 
-void
-parse_cxx(const char* path, const char** clang_opts, VALUE* store)
+static void
+parse_cxx_inclusion_callback(CXFile file, CXSourceLocation* inclusion_stack,
+                             unsigned inclusion_stack_len, CXClientData data)
 {
-    char opt_sysincdir[PATH_MAX] = { 0 };
-    ARRAY argv = ARRAY_INITIALIZER;
-    int i;
-    CXIndex index;
-    CXTranslationUnit unit;
-    CXCursor unit_cursor;
-    enum CXErrorCode err;
-    PARSE_CXX_CONTEXT ctx;
+    ARRAY* deps = (ARRAY*) data;
+    CXString name;
+    char* dep;
 
-    ctx.store = store;
-    ctx.val_file = store_register_file(store, path);
+    /* Skip the main file itself. */
+    if(inclusion_stack_len == 0)
+        return;
+
+    name = clang_getFileName(file);
+    dep = strdup(clang_getCString(name));
+    CHECK(dep != NULL);
+    CHECK(array_append(deps, dep) == 0);
+    clang_disposeString(name);
+}
 
-    /* Build options for libclang. */
-    CHECK(array_append(&argv, "-DDOCBAKER") == 0);
+/* Build options for libclang. The array is NULL-terminated. */
+static void
+parse_cxx_build_argv(ARRAY* argv, char opt_sysincdir[PATH_MAX], const char** clang_opts)
+{
+    int i;
+
+    CHECK(array_append(argv, "-DDOCBAKER") == 0);
 
 #ifdef _WIN32
     /* On Windows, we distribute the headers for libclang in the package
@@ -148,10 +394,49 @@ parse_cxx(const char* path, const char** clang_opts, VALUE* store)
 #else
     snprintf(opt_sysincdir, PATH_MAX-1, "-isystem%s", CLANG_SYSINCDIR);
 #endif
-    CHECK(array_append(&argv, opt_sysincdir) == 0);
+    CHECK(array_append(argv, opt_sysincdir) == 0);
     for(i = 0; clang_opts[i] != NULL; i++)
-        CHECK(array_append(&argv, (void*) clang_opts[i]) == 0);
-    CHECK(array_append(&argv, NULL) == 0);
+        CHECK(array_append(argv, (void*) clang_opts[i]) == 0);
+    CHECK(array_append(argv, NULL) == 0);
+}
+
+uint64_t
+parse_cxx_options_hash(uint64_t hash, const char** clang_opts)
+{
+    char opt_sysincdir[PATH_MAX] = { 0 };
+    ARRAY argv = ARRAY_INITIALIZER;
+    const char* arg;
+    size_t i;
+
+    parse_cxx_build_argv(&argv, opt_sysincdir, clang_opts);
+    for(i = 0; i < array_size(&argv) - 1; i++) {
+        arg = (const char*) array_get(&argv, i);
+        hash = fnv1a_64(hash, arg, strlen(arg) + 1);
+    }
+    array_fini(&argv, NULL);
+
+    return hash;
+}
+
+int
+parse_cxx(const char* path, const char** clang_opts, STORE* store, ARRAY* deps)
+{
+    char opt_sysincdir[PATH_MAX] = { 0 };
+    ARRAY argv = ARRAY_INITIALIZER;
+    CXIndex index;
+    CXTranslationUnit unit;
+    CXCursor unit_cursor;
+    enum CXErrorCode err;
+    PARSE_CXX_CONTEXT ctx;
+    int ret = -1;
+
+    ctx.store = store;
+    ctx.file = store_register_file(store, path);
+    buffer_init(&ctx.long_name);
+    buffer_init(&ctx.refs);
+    buffer_init(&ctx.ref_ptrs);
+
+    parse_cxx_build_argv(&argv, opt_sysincdir, clang_opts);
 
     /* Parse the translation unit. */
     index = clang_createIndex(0, 1);
@@ -175,9 +460,17 @@ parse_cxx(const char* path, const char** clang_opts, VALUE* store)
      * documentation. */
     clang_visitChildren(unit_cursor, parse_cxx_callback, (CXClientData) &ctx);
 
+    if(deps != NULL)
+        clang_getInclusions(unit, parse_cxx_inclusion_callback, (CXClientData) deps);
+    ret = 0;
+
     clang_disposeTranslationUnit(unit);
 err_parseTranslationUnit2:
     clang_disposeIndex(index);
 err_createIndex:
     array_fini(&argv, NULL);
+    buffer_fini(&ctx.long_name);
+    buffer_fini(&ctx.refs);
+    buffer_fini(&ctx.ref_ptrs);
+    return ret;
 }
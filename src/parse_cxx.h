@@ -27,10 +27,20 @@
 #define DOCBAKER_PARSE_CXX_H
 
 #include "misc.h"
-#include "value.h"
+#include "array.h"
+#include "store.h"
 
 
-void parse_cxx(const char* path, const char** clang_opts, VALUE* store);
+/* Parse the file and add everything we find in it into the store.
+ * Returns zero on success, or -1 if libclang fails to parse it.
+ *
+ * If `deps` is not NULL, paths of all the files (transitively) included by
+ * the file are appended into it. Caller is responsible to free() them. */
+int parse_cxx(const char* path, const char** clang_opts, STORE* store, ARRAY* deps);
+
+/* Feed the hash with all the options parse_cxx() would pass to libclang.
+ * Useful to detect whether results of a previous run are still valid. */
+uint64_t parse_cxx_options_hash(uint64_t hash, const char** clang_opts);
 
 
 #endif  /* DOCBAKER_PARSE_CXX_H */
@@ -24,6 +24,10 @@
  */
 
 #include "path_util.h"
+#include "fnv1a.h"
+#include "htable.h"
+
+#include <fcntl.h>
 
 #ifndef _WIN32
     #include <dirent.h>
@@ -42,6 +46,24 @@ struct PATH_DIR {
 
 static char path_to_exe[PATH_MAX] = { 0 };
 
+#ifndef _WIN32
+/* mkstemp() creates the file accessible by the owner only. Files we create
+ * through path_create_temp() should get the permissions fopen() would give
+ * them. */
+static mode_t path_umask = 022;
+#endif
+
+
+#ifndef _WIN32
+/* Cache of canonical paths of directories (see path_canonical()). */
+typedef struct PATH_CANON_ENTRY {
+    char* path;
+    char* canon;
+} PATH_CANON_ENTRY;
+
+static HTABLE path_canon_cache = HTABLE_INITIALIZER;
+#endif
+
 
 PATH_DIR*
 path_opendir(const char* path)
@@ -180,6 +202,232 @@ path_is_dir(const char* path)
     return (stat(path, &s) == 0  &&  S_ISDIR(s.st_mode)) ? 1 : 0;
 }
 
+int
+path_rename(const char* old_path, const char* new_path)
+{
+#ifdef _WIN32
+    if(!MoveFileExA(old_path, new_path, MOVEFILE_REPLACE_EXISTING)) {
+        errno = EACCES;
+        return -1;
+    }
+    return 0;
+#else
+    return rename(old_path, new_path);
+#endif
+}
+
+FILE*
+path_create_temp(const char* path, const char* mode, char tmp_path[PATH_MAX])
+{
+    int fd;
+    FILE* f;
+
+    if(snprintf(tmp_path, PATH_MAX, "%s.tmp.XXXXXX", path) >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+#ifdef _WIN32
+    {
+        static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+        static volatile LONG counter = 0;
+        char* suffix = tmp_path + strlen(tmp_path) - 6;
+        uint64_t seed;
+        int attempt, i;
+
+        seed = ((uint64_t) GetCurrentProcessId() << 32) ^ GetTickCount64() ^
+               ((uint64_t) InterlockedIncrement(&counter) * 0x9e3779b97f4a7c15ULL);
+        for(attempt = 0; attempt < 100; attempt++) {
+            for(i = 0; i < 6; i++) {
+                /* xorshift64 */
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                suffix[i] = chars[seed % (sizeof(chars) - 1)];
+            }
+            fd = _open(tmp_path, _O_CREAT | _O_EXCL | _O_WRONLY |
+                        (strchr(mode, 'b') != NULL ? _O_BINARY : _O_TEXT),
+                        _S_IREAD | _S_IWRITE);
+            if(fd >= 0  ||  errno != EEXIST)
+                break;
+        }
+    }
+#else
+    fd = mkstemp(tmp_path);
+    if(fd >= 0)
+        fchmod(fd, 0666 & ~path_umask);
+#endif
+    if(fd < 0)
+        return NULL;
+
+    f = fdopen(fd, mode);
+    if(f == NULL) {
+        close(fd);
+        remove(tmp_path);
+    }
+    return f;
+}
+
+#ifndef _WIN32
+static int
+path_canon_entry_cmp(const void* item, const void* key)
+{
+    return strcmp(((const PATH_CANON_ENTRY*) item)->path, (const char*) key);
+}
+
+static void
+path_canon_entry_free(void* item)
+{
+    PATH_CANON_ENTRY* entry = (PATH_CANON_ENTRY*) item;
+
+    free(entry->path);
+    free(entry->canon);
+    free(entry);
+}
+
+static const char*
+path_canonical_dir(const char* dir)
+{
+    char buffer[PATH_MAX];
+    PATH_CANON_ENTRY* entry;
+    uint64_t hash;
+
+    hash = fnv1a_64(FNV1A_BASE_64, dir, strlen(dir));
+    entry = (PATH_CANON_ENTRY*) htable_lookup(&path_canon_cache, hash, path_canon_entry_cmp, dir);
+    if(entry != NULL)
+        return entry->canon;
+
+    if(realpath(dir, buffer) == NULL)
+        return NULL;
+
+    entry = (PATH_CANON_ENTRY*) malloc(sizeof(PATH_CANON_ENTRY));
+    CHECK(entry != NULL);
+    entry->path = strdup(dir);
+    entry->canon = strdup(buffer);
+    CHECK(entry->path != NULL  &&  entry->canon != NULL);
+    CHECK(htable_insert(&path_canon_cache, hash, entry) == 0);
+    return entry->canon;
+}
+#endif
+
+int
+path_canonical(const char* path, char buffer[PATH_MAX])
+{
+#ifdef _WIN32
+    return (_fullpath(buffer, path, PATH_MAX) != NULL ? 0 : -1);
+#else
+    const char* base;
+    const char* canon_dir;
+    char dir[PATH_MAX];
+    size_t dir_len;
+    size_t canon_dir_len;
+    size_t base_len;
+    struct stat s;
+
+    base = path_basename(path);
+    dir_len = base - path;
+
+    /* If the last component is a symlink itself (or some special thing),
+     * the directory cache would not help us. Resolve the whole path. */
+    if(lstat(path, &s) != 0)
+        return -1;
+    if(S_ISLNK(s.st_mode)  ||  base[0] == '\0'  ||
+       strcmp(base, ".") == 0  ||  strcmp(base, "..") == 0)
+        return (realpath(path, buffer) != NULL ? 0 : -1);
+
+    if(dir_len == 0) {
+        strcpy(dir, ".");
+    } else {
+        memcpy(dir, path, dir_len);
+        dir[dir_len] = '\0';
+    }
+
+    canon_dir = path_canonical_dir(dir);
+    if(canon_dir == NULL)
+        return -1;
+
+    canon_dir_len = strlen(canon_dir);
+    base_len = strlen(base);
+    if(canon_dir_len + 1 + base_len >= PATH_MAX) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(buffer, canon_dir, canon_dir_len);
+    if(canon_dir_len == 0  ||  canon_dir[canon_dir_len-1] != '/')
+        buffer[canon_dir_len++] = '/';
+    memcpy(buffer + canon_dir_len, base, base_len + 1);
+    return 0;
+#endif
+}
+
+int
+path_normalize(const char* path, char buffer[PATH_MAX])
+{
+    size_t len = 0;
+    size_t root_len = 0;    /* Part of the buffer ".." may never remove. */
+    const char* comp;
+    size_t comp_len;
+
+#ifdef _WIN32
+    /* Keep drive letter. */
+    if(((path[0] >= 'a' && path[0] <= 'z') || (path[0] >= 'A' && path[0] <= 'Z'))  &&  path[1] == ':') {
+        buffer[len++] = path[0];
+        buffer[len++] = ':';
+        path += 2;
+    }
+    #define IS_SEP(ch)      ((ch) == '/' || (ch) == '\\')
+#else
+    #define IS_SEP(ch)      ((ch) == '/')
+#endif
+
+    if(IS_SEP(*path))
+        buffer[len++] = '/';
+    root_len = len;
+
+    while(*path != '\0') {
+        while(IS_SEP(*path))
+            path++;
+        comp = path;
+        while(*path != '\0'  &&  !IS_SEP(*path))
+            path++;
+        comp_len = path - comp;
+
+        if(comp_len == 0  ||  (comp_len == 1  &&  comp[0] == '.'))
+            continue;
+
+        if(comp_len == 2  &&  comp[0] == '.'  &&  comp[1] == '.') {
+            /* ".." in the root directory is the root directory. */
+            if(len == root_len  &&  root_len > 0  &&  buffer[root_len-1] == '/')
+                continue;
+        }
+
+        if(comp_len == 2  &&  comp[0] == '.'  &&  comp[1] == '.'  &&  len > root_len) {
+            /* Remove the last component unless it is ".." itself. */
+            size_t last = len;
+            while(last > root_len  &&  buffer[last-1] != '/')
+                last--;
+            if(!(len - last == 2  &&  buffer[last] == '.'  &&  buffer[last+1] == '.')) {
+                len = (last > root_len ? last - 1 : root_len);
+                continue;
+            }
+        }
+
+        if(len + (len > root_len ? 1 : 0) + comp_len >= PATH_MAX)
+            return -1;
+        if(len > root_len)
+            buffer[len++] = '/';
+        memcpy(buffer + len, comp, comp_len);
+        len += comp_len;
+    }
+
+#undef IS_SEP
+
+    if(len == 0)
+        buffer[len++] = '.';
+    buffer[len] = '\0';
+    return 0;
+}
+
 void
 path_init(const char* argv0)
 {
@@ -187,4 +435,17 @@ path_init(const char* argv0)
     *(char*) path_basename(path_to_exe) = '\0';
     if(path_to_exe[0] == '\0')
         strcpy(path_to_exe, "./");
+
+#ifndef _WIN32
+    path_umask = umask(0);
+    umask(path_umask);
+#endif
+}
+
+void
+path_fini(void)
+{
+#ifndef _WIN32
+    htable_fini(&path_canon_cache, path_canon_entry_free);
+#endif
 }
@@ -45,8 +45,43 @@ const char* path_extension(const char* path);
 
 int path_is_dir(const char* path);
 
+/* Like rename(), but replace the target if it exists on all platforms.
+ * (Together with writing into a temporary file first, this allows to
+ * atomically replace a file with new contents.) */
+int path_rename(const char* old_path, const char* new_path);
+
+/* Create and open (with fopen()-like `mode`) a new file with a unique name
+ * next to `path`. The name is stored into `tmp_path` and it always
+ * contains ".tmp.". Unlike names derived from the process ID, the name is
+ * unique even among processes in different PID namespaces sharing the
+ * directory.
+ *
+ * Returns NULL on failure (errno is then set).
+ */
+FILE* path_create_temp(const char* path, const char* mode, char tmp_path[PATH_MAX]);
+
+/* Get canonical form of the path, i.e. an absolute path with all symbolic
+ * links, "." and ".." resolved. Canonical paths of directories are cached,
+ * so resolving many files living in the same directory is cheap.
+ *
+ * Returns zero on success, or -1 on failure (errno is then set).
+ *
+ * Note the cache is not guarded by any lock. Call only from the main thread.
+ */
+int path_canonical(const char* path, char buffer[PATH_MAX]);
+
+/* Normalize the path lexically (without touching the file system): Use '/'
+ * as the only separator, and remove empty and "." components as well as
+ * resolvable ".." components. E.g. "./foo//bar/../baz.h" becomes
+ * "foo/baz.h".
+ *
+ * Returns zero on success, or -1 if the result does not fit into PATH_MAX.
+ */
+int path_normalize(const char* path, char buffer[PATH_MAX]);
+
 
 void path_init(const char* argv0);
+void path_fini(void);
 
 
 #endif  /* DOCBAKER_PATH_H */
@@ -0,0 +1,689 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "snapshot.h"
+#include "arena.h"
+#include "buffer.h"
+#include "fnv1a.h"
+#include "htable.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+#endif
+
+
+#define SNAPSHOT_BYTE_ORDER     0x01020304
+#define SNAPSHOT_NO_KEY         UINT64_MAX
+
+
+/*************************
+ *** Snapshot writing  ***
+ *************************/
+
+typedef struct SNAPSHOT_QUEUE_ITEM {
+    const VALUE* key;
+    const VALUE* value;
+} SNAPSHOT_QUEUE_ITEM;
+
+/* Children of a container already written (or queued), for hash-consing:
+ * containers with equal contents share a single range of children. */
+typedef struct SNAPSHOT_CONS {
+    const VALUE* value;
+    uint64_t first;         /* Index of the first child. */
+} SNAPSHOT_CONS;
+
+typedef struct SNAPSHOT_WRITER {
+    FILE* f;
+    BUFFER strings;
+    HTABLE string_index;    /* Items are (offset + 1) into strings. */
+    HTABLE cons_index;      /* SNAPSHOT_CONS (in cons_arena) */
+    ARENA cons_arena;
+    BUFFER queue;           /* SNAPSHOT_QUEUE_ITEM */
+    size_t queue_head;
+    uint64_t n_nodes;       /* Count of nodes with an assigned index. */
+    uint64_t n_shared;      /* Count of nodes not written thanks to sharing. */
+} SNAPSHOT_WRITER;
+
+typedef struct SNAPSHOT_STRING_KEY {
+    const BUFFER* strings;
+    const char* str;
+    size_t len;
+} SNAPSHOT_STRING_KEY;
+
+
+static int
+snapshot_string_cmp(const void* item, const void* key)
+{
+    const SNAPSHOT_STRING_KEY* k = (const SNAPSHOT_STRING_KEY*) key;
+    const char* data = (const char*) k->strings->data;
+    size_t offset = (size_t) ((uintptr_t) item - 1);
+
+    if(offset + k->len >= buffer_size(k->strings))
+        return 1;
+    if(memcmp(data + offset, k->str, k->len) != 0  ||  data[offset + k->len] != '\0')
+        return 1;
+    return 0;
+}
+
+/* Add the string into the string table (unless already there) and return
+ * its offset. */
+static uint64_t
+snapshot_intern(SNAPSHOT_WRITER* w, const char* str, size_t len)
+{
+    SNAPSHOT_STRING_KEY key = { &w->strings, str, len };
+    uint64_t hash;
+    void* item;
+    size_t offset;
+
+    /* Strings with an embedded NUL are rare, and the comparator could
+     * mistake them with their prefix. Just do not share them. */
+    if(memchr(str, '\0', len) != NULL) {
+        offset = buffer_size(&w->strings);
+        CHECK(buffer_append(&w->strings, str, len) == 0);
+        CHECK(buffer_append(&w->strings, "", 1) == 0);
+        return offset;
+    }
+
+    hash = fnv1a_64(FNV1A_BASE_64, str, len);
+    item = htable_lookup(&w->string_index, hash, snapshot_string_cmp, &key);
+    if(item != NULL)
+        return (uint64_t) ((uintptr_t) item - 1);
+
+    offset = buffer_size(&w->strings);
+    CHECK(buffer_append(&w->strings, str, len) == 0);
+    CHECK(buffer_append(&w->strings, "", 1) == 0);
+    CHECK(htable_insert(&w->string_index, hash, (void*) (uintptr_t) (offset + 1)) == 0);
+    return offset;
+}
+
+static void
+snapshot_enqueue(SNAPSHOT_WRITER* w, const VALUE* key, const VALUE* value)
+{
+    SNAPSHOT_QUEUE_ITEM item = { key, value };
+
+    CHECK(buffer_append(&w->queue, &item, sizeof(SNAPSHOT_QUEUE_ITEM)) == 0);
+    w->n_nodes++;
+}
+
+static int
+snapshot_enqueue_dict_item(const VALUE* key, VALUE* value, void* ctx)
+{
+    snapshot_enqueue((SNAPSHOT_WRITER*) ctx, key, value);
+    return 0;
+}
+
+/* The payload of a scalar node, as stored in SNAPSHOT_NODE::a. */
+static uint64_t
+snapshot_scalar(const VALUE* v)
+{
+    uint64_t bits = 0;
+    double d;
+
+    switch(value_type(v)) {
+        case VALUE_BOOL:    bits = (uint64_t) value_bool(v); break;
+        case VALUE_INT32:   bits = (uint64_t) (int64_t) value_int32(v); break;
+        case VALUE_UINT32:  bits = (uint64_t) value_uint32(v); break;
+        case VALUE_INT64:   bits = (uint64_t) value_int64(v); break;
+        case VALUE_UINT64:  bits = value_uint64(v); break;
+
+        case VALUE_FLOAT:
+        case VALUE_DOUBLE:
+            d = value_double(v);
+            memcpy(&bits, &d, sizeof(double));
+            break;
+
+        default:
+            break;
+    }
+
+    return bits;
+}
+
+/* Containers with bigger subtrees are not shared. They are unlikely to
+ * repeat (it is the records of symbols and smaller things which do) and
+ * hashing each of them whole would make writing the snapshot O(n * depth). */
+#define SNAPSHOT_CONS_MAX_NODES     256
+
+typedef struct SNAPSHOT_HASH {
+    uint64_t hash;
+    size_t budget;          /* How many more nodes may be hashed. */
+} SNAPSHOT_HASH;
+
+static void snapshot_hash_value(SNAPSHOT_HASH* h, const VALUE* v);
+
+static void
+snapshot_hash_string(SNAPSHOT_HASH* h, const char* str, size_t len)
+{
+    uint64_t len64 = (uint64_t) len;
+
+    h->hash = fnv1a_64(h->hash, &len64, sizeof(uint64_t));
+    h->hash = fnv1a_64(h->hash, str, len);
+}
+
+static int
+snapshot_hash_dict_item(const VALUE* key, VALUE* value, void* ctx)
+{
+    SNAPSHOT_HASH* h = (SNAPSHOT_HASH*) ctx;
+
+    snapshot_hash_string(h, value_string(key), value_string_length(key));
+    snapshot_hash_value(h, value);
+    return (h->budget > 0 ? 0 : -1);
+}
+
+/* Structural hash of the value: fnv1a_64() over the type and the payload
+ * (recursively for arrays and dictionaries, including the keys). Values
+ * which would be written as equal subtrees have equal hashes. Gives up
+ * (leaving h->budget zero) if the value has too many nodes. */
+static void
+snapshot_hash_value(SNAPSHOT_HASH* h, const VALUE* v)
+{
+    uint32_t type = (uint32_t) value_type(v);
+    uint64_t bits;
+    size_t i, n;
+
+    if(h->budget == 0)
+        return;
+    h->budget--;
+
+    h->hash = fnv1a_64(h->hash, &type, sizeof(uint32_t));
+    switch(value_type(v)) {
+        case VALUE_STRING:
+            snapshot_hash_string(h, value_string(v), value_string_length(v));
+            break;
+
+        case VALUE_ARRAY:
+            n = value_array_size(v);
+            for(i = 0; i < n  &&  h->budget > 0; i++)
+                snapshot_hash_value(h, value_array_get(v, i));
+            break;
+
+        case VALUE_DICT:
+            value_dict_walk_sorted(v, snapshot_hash_dict_item, h);
+            break;
+
+        default:
+            bits = snapshot_scalar(v);
+            h->hash = fnv1a_64(h->hash, &bits, sizeof(uint64_t));
+            break;
+    }
+}
+
+static int snapshot_value_equal(const VALUE* a, const VALUE* b);
+
+static int
+snapshot_equal_dict_item(const VALUE* key, VALUE* value, void* ctx)
+{
+    const VALUE* other;
+
+    other = value_dict_get_((const VALUE*) ctx, value_string(key), value_string_length(key));
+    return (other != NULL  &&  snapshot_value_equal(value, other) ? 0 : -1);
+}
+
+static int
+snapshot_value_equal(const VALUE* a, const VALUE* b)
+{
+    size_t i, n;
+
+    if(a == b)
+        return 1;
+    if(value_type(a) != value_type(b))
+        return 0;
+
+    switch(value_type(a)) {
+        case VALUE_STRING:
+            n = value_string_length(a);
+            return (n == value_string_length(b)  &&  memcmp(value_string(a), value_string(b), n) == 0);
+
+        case VALUE_ARRAY:
+            n = value_array_size(a);
+            if(n != value_array_size(b))
+                return 0;
+            for(i = 0; i < n; i++) {
+                if(!snapshot_value_equal(value_array_get(a, i), value_array_get(b, i)))
+                    return 0;
+            }
+            return 1;
+
+        case VALUE_DICT:
+            return (value_dict_size(a) == value_dict_size(b)  &&
+                    value_dict_walk_sorted(a, snapshot_equal_dict_item, (void*) b) == 0);
+
+        default:
+            return (snapshot_scalar(a) == snapshot_scalar(b));
+    }
+}
+
+static int
+snapshot_cons_cmp(const void* item, const void* key)
+{
+    return !snapshot_value_equal(((const SNAPSHOT_CONS*) item)->value, (const VALUE*) key);
+}
+
+/* Get index of the first child of the (non-empty) container. If a container
+ * with equal contents has been seen already, its children are reused;
+ * otherwise the children are queued to be written. */
+static uint64_t
+snapshot_children(SNAPSHOT_WRITER* w, const VALUE* v, size_t n)
+{
+    SNAPSHOT_HASH h = { FNV1A_BASE_64, SNAPSHOT_CONS_MAX_NODES + 1 };
+    SNAPSHOT_CONS* cons;
+    uint64_t first = w->n_nodes;
+    size_t i;
+
+    snapshot_hash_value(&h, v);
+    if(h.budget > 0) {
+        cons = (SNAPSHOT_CONS*) htable_lookup(&w->cons_index, h.hash, snapshot_cons_cmp, v);
+        if(cons != NULL) {
+            w->n_shared += n;
+            return cons->first;
+        }
+
+        cons = (SNAPSHOT_CONS*) arena_alloc(&w->cons_arena, sizeof(SNAPSHOT_CONS));
+        cons->value = v;
+        cons->first = first;
+        CHECK(htable_insert(&w->cons_index, h.hash, cons) == 0);
+    }
+
+    /* Children get the next free indexes. As we write the nodes in the
+     * order of the queue, they end up in a contiguous range. */
+    if(value_type(v) == VALUE_ARRAY) {
+        for(i = 0; i < n; i++)
+            snapshot_enqueue(w, NULL, value_array_get(v, i));
+    } else {
+        value_dict_walk_sorted(v, snapshot_enqueue_dict_item, w);
+    }
+    return first;
+}
+
+static void
+snapshot_make_node(SNAPSHOT_WRITER* w, const SNAPSHOT_QUEUE_ITEM* item, SNAPSHOT_NODE* node)
+{
+    const VALUE* v = item->value;
+
+    memset(node, 0, sizeof(SNAPSHOT_NODE));
+    node->type = (uint32_t) value_type(v);
+
+    if(item->key != NULL) {
+        node->key = snapshot_intern(w, value_string(item->key), value_string_length(item->key));
+        node->key_len = (uint32_t) value_string_length(item->key);
+    } else {
+        node->key = SNAPSHOT_NO_KEY;
+    }
+
+    switch(value_type(v)) {
+        case VALUE_STRING:
+            node->a = snapshot_intern(w, value_string(v), value_string_length(v));
+            node->b = (uint64_t) value_string_length(v);
+            break;
+
+        case VALUE_ARRAY:
+        case VALUE_DICT:
+            node->b = (uint64_t) (value_type(v) == VALUE_ARRAY ? value_array_size(v) : value_dict_size(v));
+            node->a = (node->b > 0 ? snapshot_children(w, v, (size_t) node->b) : w->n_nodes);
+            break;
+
+        default:
+            node->a = snapshot_scalar(v);
+            break;
+    }
+}
+
+int
+snapshot_write(const VALUE* store, const char* path)
+{
+    SNAPSHOT_WRITER w;
+    SNAPSHOT_HEADER header;
+    SNAPSHOT_QUEUE_ITEM item;
+    SNAPSHOT_NODE node;
+    int ret = -1;
+
+    memset(&w, 0, sizeof(SNAPSHOT_WRITER));
+    arena_init(&w.cons_arena);
+    w.f = fopen(path, "wb");
+    if(w.f == NULL) {
+        ERROR("%s (%s)", strerror(errno), path);
+        arena_fini(&w.cons_arena);
+        return -1;
+    }
+
+    /* Placeholder; the real header is written when we know the counts. */
+    memset(&header, 0, sizeof(SNAPSHOT_HEADER));
+    if(fwrite(&header, sizeof(SNAPSHOT_HEADER), 1, w.f) != 1)
+        goto err;
+
+    /* Breadth-first walk. The nodes are written out in a single pass in
+     * the order they are dequeued. */
+    snapshot_enqueue(&w, NULL, store);
+    while(w.queue_head < buffer_size(&w.queue) / sizeof(SNAPSHOT_QUEUE_ITEM)) {
+        item = ((SNAPSHOT_QUEUE_ITEM*) w.queue.data)[w.queue_head++];
+        snapshot_make_node(&w, &item, &node);
+        if(fwrite(&node, sizeof(SNAPSHOT_NODE), 1, w.f) != 1)
+            goto err;
+
+        /* Do not let the consumed head of the queue grow unbounded. */
+        if(w.queue_head >= 4096  &&  w.queue_head * 2 >= buffer_size(&w.queue) / sizeof(SNAPSHOT_QUEUE_ITEM)) {
+            buffer_remove(&w.queue, 0, w.queue_head * sizeof(SNAPSHOT_QUEUE_ITEM));
+            w.queue_head = 0;
+        }
+    }
+
+    if(buffer_size(&w.strings) > 0  &&
+       fwrite(w.strings.data, buffer_size(&w.strings), 1, w.f) != 1)
+        goto err;
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.n_nodes = w.n_nodes;
+    header.strings_offset = sizeof(SNAPSHOT_HEADER) + w.n_nodes * sizeof(SNAPSHOT_NODE);
+    header.strings_size = buffer_size(&w.strings);
+    if(fseek(w.f, 0, SEEK_SET) != 0  ||  fwrite(&header, sizeof(SNAPSHOT_HEADER), 1, w.f) != 1)
+        goto err;
+
+    NOTE(1, _("Snapshot: %u nodes (%u more shared)."),
+              (unsigned) w.n_nodes, (unsigned) w.n_shared);
+    ret = 0;
+
+err:
+    if(fclose(w.f) != 0)
+        ret = -1;
+    if(ret != 0)
+        ERROR("%s (%s)", strerror(errno), path);
+    buffer_fini(&w.strings);
+    buffer_fini(&w.queue);
+    htable_fini(&w.string_index, NULL);
+    htable_fini(&w.cons_index, NULL);
+    arena_fini(&w.cons_arena);
+    return ret;
+}
+
+
+/*************************
+ *** Snapshot reading  ***
+ *************************/
+
+int
+snapshot_open(SNAPSHOT* snap, const char* path)
+{
+    const SNAPSHOT_HEADER* header;
+    void* base;
+    size_t size;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+    LARGE_INTEGER file_size;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        ERROR(_("Cannot open %s."), path);
+        return -1;
+    }
+    if(!GetFileSizeEx(file, &file_size)  ||  file_size.QuadPart < (LONGLONG) sizeof(SNAPSHOT_HEADER)) {
+        CloseHandle(file);
+        goto malformed;
+    }
+    size = (size_t) file_size.QuadPart;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping == NULL) {
+        ERROR(_("Cannot map %s."), path);
+        return -1;
+    }
+    /* The view keeps the mapping alive on its own. */
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if(base == NULL) {
+        ERROR(_("Cannot map %s."), path);
+        return -1;
+    }
+#else
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        ERROR("%s (%s)", strerror(errno), path);
+        return -1;
+    }
+    if(fstat(fd, &st) != 0  ||  (size_t) st.st_size < sizeof(SNAPSHOT_HEADER)) {
+        close(fd);
+        goto malformed;
+    }
+    size = (size_t) st.st_size;
+    base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        ERROR("%s (%s)", strerror(errno), path);
+        return -1;
+    }
+#endif
+
+    snap->base = base;
+    snap->size = size;
+
+    /* Check the header only. Everything else is checked lazily by the
+     * accessors so opening does not depend on the snapshot size. */
+    header = (const SNAPSHOT_HEADER*) base;
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0  ||
+       header->version != SNAPSHOT_VERSION  ||
+       header->byte_order != SNAPSHOT_BYTE_ORDER  ||
+       header->n_nodes == 0  ||
+       header->n_nodes > (size - sizeof(SNAPSHOT_HEADER)) / sizeof(SNAPSHOT_NODE)  ||
+       header->strings_offset != sizeof(SNAPSHOT_HEADER) + header->n_nodes * sizeof(SNAPSHOT_NODE)  ||
+       header->strings_size > size - header->strings_offset)
+    {
+        snapshot_close(snap);
+        goto malformed;
+    }
+
+    snap->nodes = (const SNAPSHOT_NODE*) ((const char*) base + sizeof(SNAPSHOT_HEADER));
+    snap->n_nodes = header->n_nodes;
+    snap->strings = (const char*) base + header->strings_offset;
+    snap->strings_size = header->strings_size;
+    return 0;
+
+malformed:
+    ERROR(_("%s: Malformed snapshot."), path);
+    return -1;
+}
+
+void
+snapshot_close(SNAPSHOT* snap)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(snap->base);
+#else
+    munmap(snap->base, snap->size);
+#endif
+    memset(snap, 0, sizeof(SNAPSHOT));
+}
+
+const SNAPSHOT_NODE*
+snapshot_root(const SNAPSHOT* snap)
+{
+    return &snap->nodes[0];
+}
+
+VALUE_TYPE
+snapshot_type(const SNAPSHOT_NODE* node)
+{
+    if(node == NULL  ||  node->type > VALUE_DICT)
+        return VALUE_NULL;
+    return (VALUE_TYPE) node->type;
+}
+
+static const char*
+snapshot_str(const SNAPSHOT* snap, uint64_t offset, uint64_t len)
+{
+    if(offset >= snap->strings_size  ||  len >= snap->strings_size - offset)
+        return NULL;
+    return snap->strings + offset;
+}
+
+const char*
+snapshot_key(const SNAPSHOT* snap, const SNAPSHOT_NODE* node)
+{
+    if(node == NULL  ||  node->key == SNAPSHOT_NO_KEY)
+        return NULL;
+    return snapshot_str(snap, node->key, node->key_len);
+}
+
+int
+snapshot_bool(const SNAPSHOT_NODE* node)
+{
+    return (snapshot_type(node) == VALUE_BOOL  &&  node->a != 0);
+}
+
+int64_t
+snapshot_int64(const SNAPSHOT_NODE* node)
+{
+    switch(snapshot_type(node)) {
+        case VALUE_INT32:
+        case VALUE_UINT32:
+        case VALUE_INT64:
+        case VALUE_UINT64:
+            return (int64_t) node->a;
+        case VALUE_FLOAT:
+        case VALUE_DOUBLE:
+            return (int64_t) snapshot_double(node);
+        default:
+            return 0;
+    }
+}
+
+uint64_t
+snapshot_uint64(const SNAPSHOT_NODE* node)
+{
+    switch(snapshot_type(node)) {
+        case VALUE_INT32:
+        case VALUE_UINT32:
+        case VALUE_INT64:
+        case VALUE_UINT64:
+            return node->a;
+        case VALUE_FLOAT:
+        case VALUE_DOUBLE:
+            return (uint64_t) snapshot_double(node);
+        default:
+            return 0;
+    }
+}
+
+double
+snapshot_double(const SNAPSHOT_NODE* node)
+{
+    double d;
+
+    switch(snapshot_type(node)) {
+        case VALUE_INT32:
+        case VALUE_INT64:
+            return (double) (int64_t) node->a;
+        case VALUE_UINT32:
+        case VALUE_UINT64:
+            return (double) node->a;
+        case VALUE_FLOAT:
+        case VALUE_DOUBLE:
+            memcpy(&d, &node->a, sizeof(double));
+            return d;
+        default:
+            return 0.0;
+    }
+}
+
+const char*
+snapshot_string(const SNAPSHOT* snap, const SNAPSHOT_NODE* node)
+{
+    if(snapshot_type(node) != VALUE_STRING)
+        return NULL;
+    return snapshot_str(snap, node->a, node->b);
+}
+
+size_t
+snapshot_string_length(const SNAPSHOT_NODE* node)
+{
+    if(snapshot_type(node) != VALUE_STRING)
+        return 0;
+    return (size_t) node->b;
+}
+
+size_t
+snapshot_size(const SNAPSHOT_NODE* node)
+{
+    switch(snapshot_type(node)) {
+        case VALUE_ARRAY:
+        case VALUE_DICT:
+            return (size_t) node->b;
+        default:
+            return 0;
+    }
+}
+
+const SNAPSHOT_NODE*
+snapshot_child(const SNAPSHOT* snap, const SNAPSHOT_NODE* node, size_t i)
+{
+    if(i >= snapshot_size(node)  ||  node->a >= snap->n_nodes  ||  i >= snap->n_nodes - node->a)
+        return NULL;
+    return &snap->nodes[node->a + i];
+}
+
+const SNAPSHOT_NODE*
+snapshot_dict_get(const SNAPSHOT* snap, const SNAPSHOT_NODE* node, const char* key)
+{
+    const SNAPSHOT_NODE* child;
+    const char* child_key;
+    size_t key_len = strlen(key);
+    size_t lo, hi, mid;
+    int cmp;
+
+    if(snapshot_type(node) != VALUE_DICT)
+        return NULL;
+
+    /* The members are sorted the same way value_dict_walk_sorted() sorts
+     * them: memcmp() of the common prefix, then the shorter goes first. */
+    lo = 0;
+    hi = snapshot_size(node);
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        child = snapshot_child(snap, node, mid);
+        child_key = snapshot_key(snap, child);
+        if(child_key == NULL)
+            return NULL;
+
+        cmp = memcmp(child_key, key, (child->key_len < key_len) ? child->key_len : key_len);
+        if(cmp == 0  &&  child->key_len != key_len)
+            cmp = (child->key_len < key_len) ? -1 : +1;
+
+        if(cmp < 0)
+            lo = mid + 1;
+        else if(cmp > 0)
+            hi = mid;
+        else
+            return child;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,122 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_SNAPSHOT_H
+#define DOCBAKER_SNAPSHOT_H
+
+#include "misc.h"
+#include "value.h"
+
+
+/* Binary snapshot of the store.
+ *
+ * Unlike the JSON output, the snapshot can be mapped into memory and used
+ * (read-only) directly, without parsing it or building any VALUE tree, so
+ * opening it takes (nearly) constant time regardless of its size.
+ *
+ * The file consists of:
+ *   -- SNAPSHOT_HEADER;
+ *   -- Array of fixed-size SNAPSHOT_NODE records. Node 0 is the root and
+ *      children of each array or dictionary form a contiguous range of the
+ *      array (dictionary members are sorted by key). The ranges are
+ *      hash-consed: containers with equal contents (e.g. the record of a
+ *      symbol declared in more files) share a single range;
+ *   -- String table. All keys and strings live there (NUL-terminated), each
+ *      distinct string only once.
+ *
+ * All the integers are in the native byte order of the machine which has
+ * written the snapshot (the header allows to detect a mismatch).
+ */
+
+#define SNAPSHOT_MAGIC          "DBSNAP\r\n"
+#define SNAPSHOT_VERSION        1
+
+typedef struct SNAPSHOT_HEADER {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;        /* 0x01020304 */
+    uint64_t n_nodes;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} SNAPSHOT_HEADER;
+
+typedef struct SNAPSHOT_NODE {
+    uint32_t type;              /* VALUE_TYPE */
+    uint32_t key_len;
+    uint64_t key;               /* Offset in the string table (if a dict member). */
+    uint64_t a;                 /* Number (raw bits), string offset, or index of 1st child. */
+    uint64_t b;                 /* String length, or count of children. */
+} SNAPSHOT_NODE;
+
+typedef struct SNAPSHOT {
+    void* base;
+    size_t size;
+    const SNAPSHOT_NODE* nodes;
+    uint64_t n_nodes;
+    const char* strings;
+    uint64_t strings_size;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+} SNAPSHOT;
+
+
+/* Write the store into the file. Returns zero on success, -1 on failure
+ * (the error is reported to the user). */
+int snapshot_write(const VALUE* store, const char* path);
+
+/* Map the snapshot file into memory. Returns zero on success, -1 on failure
+ * (the error is reported to the user). */
+int snapshot_open(SNAPSHOT* snap, const char* path);
+void snapshot_close(SNAPSHOT* snap);
+
+
+/* Accessors. All of them tolerate NULL node (so missing paths can be
+ * chained) and, to survive a corrupted file, return NULL/zero for anything
+ * pointing out of the mapped file. */
+
+const SNAPSHOT_NODE* snapshot_root(const SNAPSHOT* snap);
+
+VALUE_TYPE snapshot_type(const SNAPSHOT_NODE* node);
+
+/* Key of the dictionary member (or NULL). */
+const char* snapshot_key(const SNAPSHOT* snap, const SNAPSHOT_NODE* node);
+
+int snapshot_bool(const SNAPSHOT_NODE* node);
+int64_t snapshot_int64(const SNAPSHOT_NODE* node);
+uint64_t snapshot_uint64(const SNAPSHOT_NODE* node);
+double snapshot_double(const SNAPSHOT_NODE* node);
+const char* snapshot_string(const SNAPSHOT* snap, const SNAPSHOT_NODE* node);
+size_t snapshot_string_length(const SNAPSHOT_NODE* node);
+
+/* Count of items of an array or dictionary, and i-th of them. */
+size_t snapshot_size(const SNAPSHOT_NODE* node);
+const SNAPSHOT_NODE* snapshot_child(const SNAPSHOT* snap, const SNAPSHOT_NODE* node, size_t i);
+
+/* Dictionary member lookup (binary search). */
+const SNAPSHOT_NODE* snapshot_dict_get(const SNAPSHOT* snap, const SNAPSHOT_NODE* node, const char* key);
+
+
+#endif  /* DOCBAKER_SNAPSHOT_H */
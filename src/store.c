@@ -24,36 +24,1413 @@
  */
 
 #include "store.h"
+#include "fnv1a.h"
+#include "json-dom.h"
 
 
-VALUE*
-store_register_file(VALUE* store, const char* fname)
+/* In the string table, each string is preceded by the ID of its owner: the
+ * file, for file paths, the symbol, for long names, and the symbol having it
+ * as its USR, for interned strings (if there is such symbol). So the string
+ * index doubles as the USR index. The file, the string and the symbol
+ * indexes store just the string ID (which is never zero because of the
+ * owner ID before the first string) and the key carries the store so the
+ * comparator can get to the string table. */
+#define STORE_STRING_ITEM(id)       ((void*) (uintptr_t) (id))
+#define STORE_STRING_ITEM_ID(item)  ((STORE_ID) (uintptr_t) (item))
+
+typedef struct STORE_KEY {
+    const STORE* store;
+    const char* str;
+} STORE_KEY;
+
+
+static inline STORE_FILE*
+store_file_rw(STORE* store, STORE_ID id)
+{
+    return ((STORE_FILE*) store->files.data) + id;
+}
+
+static inline STORE_REF*
+store_refs_rw(STORE* store)
+{
+    return (STORE_REF*) store->refs.data;
+}
+
+static uint64_t
+store_hash(const char* str)
+{
+    return fnv1a_64(FNV1A_BASE_64, str, strlen(str));
+}
+
+static int
+store_string_cmp(const void* item, const void* key)
+{
+    const STORE_KEY* k = (const STORE_KEY*) key;
+    return strcmp(store_string(k->store, STORE_STRING_ITEM_ID(item)), k->str);
+}
+
+/* For sorting IDs of things by their names (see store_freeze()). */
+typedef struct STORE_SORT {
+    const char* key;
+    unsigned kind;
+    STORE_ID id;
+} STORE_SORT;
+
+static int
+store_sort_cmp(const void* a, const void* b)
+{
+    const STORE_SORT* sa = (const STORE_SORT*) a;
+    const STORE_SORT* sb = (const STORE_SORT*) b;
+
+    if(sa->kind != sb->kind)
+        return (sa->kind < sb->kind ? -1 : +1);
+    return strcmp(sa->key, sb->key);
+}
+
+/* Binary search in the array of IDs sorted by the names `name_func()` gives
+ * for them. (If `ids` is NULL, the IDs are the indexes themselves.) Returns
+ * the ID with the name, or STORE_NO_ID. */
+static STORE_ID
+store_bsearch(const STORE* store, const STORE_ID* ids, size_t n,
+              const char* (*name_func)(const STORE*, STORE_ID), const char* name)
+{
+    size_t lo = 0;
+    size_t hi = n;
+    size_t mid;
+    STORE_ID id;
+    int cmp;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        id = (ids != NULL ? ids[mid] : (STORE_ID) mid);
+        cmp = strcmp(name_func(store, id), name);
+        if(cmp < 0)
+            lo = mid + 1;
+        else if(cmp > 0)
+            hi = mid;
+        else
+            return id;
+    }
+
+    return STORE_NO_ID;
+}
+
+/* Add the string into the string table. Returns its ID. */
+static STORE_ID
+store_string_add(STORE* store, STORE_ID owner, const char* str)
 {
-    // TODO
-    return NULL;
+    size_t len = strlen(str);
+    size_t offset = buffer_size(&store->strings) + sizeof(STORE_ID);
+
+    CHECK(offset + len < STORE_NO_ID);
+    CHECK(buffer_append(&store->strings, &owner, sizeof(STORE_ID)) == 0);
+    CHECK(buffer_append(&store->strings, str, len + 1) == 0);
+    return (STORE_ID) offset;
 }
 
-VALUE*
-store_register_function(VALUE* store, VALUE* file, const char* name, const char* long_name)
+static STORE_ID
+store_string_owner(const STORE* store, STORE_ID id)
 {
-    // TODO
-    return NULL;
+    STORE_ID owner;
+
+    memcpy(&owner, (const char*) store->strings.data + id - sizeof(STORE_ID), sizeof(STORE_ID));
+    return owner;
+}
+
+static void
+store_string_set_owner(STORE* store, STORE_ID id, STORE_ID owner)
+{
+    memcpy((char*) store->strings.data + id - sizeof(STORE_ID), &owner, sizeof(STORE_ID));
+}
+
+STORE_ID
+store_intern(STORE* store, const char* str)
+{
+    uint64_t hash = store_hash(str);
+    STORE_KEY key = { store, str };
+    void* item;
+    STORE_ID id;
+
+    CHECK(!store->frozen);
+    item = htable_lookup(&store->string_index, hash, store_string_cmp, &key);
+    if(item != NULL) {
+        store->n_intern_hits++;
+        store->intern_saved += strlen(str) + 1;
+        return STORE_STRING_ITEM_ID(item);
+    }
+
+    id = store_string_add(store, STORE_NO_ID, str);
+    CHECK(htable_insert(&store->string_index, hash, STORE_STRING_ITEM(id)) == 0);
+    return id;
+}
+
+static STORE_ID
+store_lookup_file_(const STORE* store, const char* path, uint64_t hash)
+{
+    STORE_KEY key = { store, path };
+    void* item;
+
+    if(store->frozen)
+        return store_bsearch(store, NULL, store_file_count(store), store_file_path, path);
+
+    item = htable_lookup(&store->file_index, hash, store_string_cmp, &key);
+    return (item != NULL ? store_string_owner(store, STORE_STRING_ITEM_ID(item)) : STORE_NO_ID);
+}
+
+static STORE_ID
+store_lookup_symbol_(const STORE* store, const char* long_name, uint64_t hash)
+{
+    STORE_KEY key = { store, long_name };
+    STORE_ID id;
+    void* item;
+
+    if(store->frozen) {
+        id = store_bsearch(store, store->symbol_keys, store->n_symbol_keys, store_string, long_name);
+    } else {
+        item = htable_lookup(&store->symbol_index, hash, store_string_cmp, &key);
+        id = (item != NULL ? STORE_STRING_ITEM_ID(item) : STORE_NO_ID);
+    }
+    return (id != STORE_NO_ID ? store_string_owner(store, id) : STORE_NO_ID);
+}
+
+STORE_ID
+store_lookup_file(const STORE* store, const char* path)
+{
+    return store_lookup_file_(store, path, store_hash(path));
+}
+
+STORE_ID
+store_lookup_symbol(const STORE* store, const char* long_name)
+{
+    return store_lookup_symbol_(store, long_name, store_hash(long_name));
+}
+
+STORE_ID
+store_lookup_usr(const STORE* store, const char* usr)
+{
+    STORE_KEY key = { store, usr };
+    STORE_ID id;
+    void* item;
+
+    if(store->frozen) {
+        id = store_bsearch(store, store->usr_keys, store->n_usr_keys, store_string, usr);
+    } else {
+        item = htable_lookup(&store->string_index, store_hash(usr), store_string_cmp, &key);
+        id = (item != NULL ? STORE_STRING_ITEM_ID(item) : STORE_NO_ID);
+    }
+    return (id != STORE_NO_ID ? store_string_owner(store, id) : STORE_NO_ID);
+}
+
+static STORE_ID
+store_register_file_(STORE* store, const char* path, uint64_t hash, const STORE_FILE* info)
+{
+    STORE_FILE file;
+    struct stat st;
+    STORE_ID id;
+
+    id = store_lookup_file_(store, path, hash);
+    if(id != STORE_NO_ID)
+        return id;
+
+    CHECK(!store->frozen);
+    id = (STORE_ID) store_file_count(store);
+    CHECK(id < STORE_MAX_FILES);
+    file.path = store_string_add(store, id, path);
+    file.hash = hash;
+    if(info != NULL) {
+        file.size = info->size;
+        file.mtime = info->mtime;
+    } else if(stat(path, &st) == 0) {
+        file.size = (uint64_t) st.st_size;
+        file.mtime = (int64_t) st.st_mtime;
+    } else {
+        file.size = 0;
+        file.mtime = 0;
+    }
+    file.symbols = NULL;
+    file.n_symbols = 0;
+    file.alloc_symbols = 0;
+    CHECK(buffer_append(&store->files, &file, sizeof(STORE_FILE)) == 0);
+    CHECK(htable_insert(&store->file_index, hash, STORE_STRING_ITEM(file.path)) == 0);
+    return id;
+}
+
+STORE_ID
+store_register_file(STORE* store, const char* path)
+{
+    return store_register_file_(store, path, store_hash(path), NULL);
+}
+
+static void
+store_file_add_symbol(STORE* store, STORE_ID file_id, STORE_ID symbol_id)
+{
+    STORE_FILE* file = store_file_rw(store, file_id);
+
+    if(file->n_symbols >= file->alloc_symbols) {
+        uint32_t alloc = (file->alloc_symbols > 0 ? file->alloc_symbols * 2 : 8);
+        STORE_ID* symbols;
+
+        symbols = (STORE_ID*) realloc(file->symbols, alloc * sizeof(STORE_ID));
+        CHECK(symbols != NULL);
+        file->symbols = symbols;
+        file->alloc_symbols = alloc;
+    }
+    file->symbols[file->n_symbols++] = symbol_id;
+}
+
+#define STORE_REALLOC_COLUMN(col, alloc)                                       \
+    do {                                                                    \
+        void* tmp_ = realloc((col), (alloc) * sizeof(*(col)));              \
+        CHECK(tmp_ != NULL);                                                \
+        (col) = tmp_;                                                       \
+    } while(0)
+
+static void
+store_symbols_realloc(STORE_SYMBOLS* symbols, size_t alloc)
+{
+    STORE_REALLOC_COLUMN(symbols->hash, alloc);
+    STORE_REALLOC_COLUMN(symbols->long_name, alloc);
+    STORE_REALLOC_COLUMN(symbols->name, alloc);
+    STORE_REALLOC_COLUMN(symbols->doc, alloc);
+    STORE_REALLOC_COLUMN(symbols->usr, alloc);
+    STORE_REALLOC_COLUMN(symbols->loc, alloc);
+    STORE_REALLOC_COLUMN(symbols->parent, alloc);
+    STORE_REALLOC_COLUMN(symbols->first_ref, alloc);
+    STORE_REALLOC_COLUMN(symbols->n_refs, alloc);
+    STORE_REALLOC_COLUMN(symbols->kind, alloc);
+    STORE_REALLOC_COLUMN(symbols->flags, alloc);
+    symbols->alloc = alloc;
+}
+
+static void
+store_symbols_grow(STORE_SYMBOLS* symbols)
+{
+    store_symbols_realloc(symbols, (symbols->alloc > 0 ? symbols->alloc * 2 : 64));
+}
+
+static void
+store_symbols_fini(STORE_SYMBOLS* symbols)
+{
+    free(symbols->hash);
+    free(symbols->long_name);
+    free(symbols->name);
+    free(symbols->doc);
+    free(symbols->usr);
+    free(symbols->loc);
+    free(symbols->parent);
+    free(symbols->first_ref);
+    free(symbols->n_refs);
+    free(symbols->kind);
+    free(symbols->flags);
+    memset(symbols, 0, sizeof(STORE_SYMBOLS));
+}
+
+/* Append a new symbol. The caller has to add it into (at least one) file. */
+static STORE_ID
+store_symbol_new(STORE* store, STORE_ID file, unsigned kind,
+                 const char* name, const char* long_name, uint64_t hash)
+{
+    STORE_SYMBOLS* symbols = &store->symbols;
+    STORE_ID id;
+
+    CHECK(!store->frozen);
+    if(symbols->count >= symbols->alloc)
+        store_symbols_grow(symbols);
+
+    id = (STORE_ID) symbols->count++;
+    symbols->hash[id] = hash;
+    symbols->long_name[id] = store_string_add(store, id, long_name);
+    symbols->name[id] = store_intern(store, name);
+    symbols->doc[id] = STORE_NO_ID;
+    symbols->usr[id] = STORE_NO_ID;
+    symbols->loc[id] = STORE_LOC_MAKE(file, 0, 0);
+    symbols->parent[id] = STORE_NO_ID;
+    symbols->first_ref[id] = 0;
+    symbols->n_refs[id] = 0;
+    symbols->kind[id] = (uint8_t) kind;
+    symbols->flags[id] = 0;
+    CHECK(htable_insert(&store->symbol_index, hash, STORE_STRING_ITEM(symbols->long_name[id])) == 0);
+    return id;
+}
+
+static STORE_ID
+store_register_symbol(STORE* store, STORE_ID file, unsigned kind,
+                      const char* name, const char* long_name)
+{
+    uint64_t hash = store_hash(long_name);
+    const STORE_FILE* f;
+    STORE_ID id;
+    uint32_t i;
+
+    id = store_lookup_symbol_(store, long_name, hash);
+    if(id == STORE_NO_ID) {
+        id = store_symbol_new(store, file, kind, name, long_name, hash);
+        store_file_add_symbol(store, file, id);
+    } else if(STORE_LOC_FILE(store->symbols.loc[id]) != file) {
+        /* A redeclaration in another file. This is rare enough so the linear
+         * scan does not hurt. */
+        f = store_file(store, file);
+        for(i = 0; i < f->n_symbols; i++) {
+            if(f->symbols[i] == id)
+                return id;
+        }
+        store_file_add_symbol(store, file, id);
+    }
+
+    return id;
+}
+
+STORE_ID
+store_register_function(STORE* store, STORE_ID file, const char* name, const char* long_name)
+{
+    return store_register_symbol(store, file, STORE_KIND_FUNCTION, name, long_name);
+}
+
+STORE_ID
+store_register_type(STORE* store, STORE_ID file, const char* name, const char* long_name)
+{
+    return store_register_symbol(store, file, STORE_KIND_TYPE, name, long_name);
+}
+
+void
+store_register_doc(STORE* store, STORE_ID symbol, const char* raw_doc)
+{
+    if(store->symbols.doc[symbol] != STORE_NO_ID  ||  raw_doc == NULL  ||  raw_doc[0] == '\0')
+        return;
+
+    store->symbols.doc[symbol] = store_intern(store, raw_doc);
+}
+
+void
+store_register_location(STORE* store, STORE_ID symbol, uint32_t line, uint32_t column)
+{
+    STORE_LOC* loc = &store->symbols.loc[symbol];
+
+    if(STORE_LOC_LINE(*loc) == 0  &&  line != 0)
+        *loc = STORE_LOC_MAKE(STORE_LOC_FILE(*loc), line, column);
+}
+
+void
+store_register_parent(STORE* store, STORE_ID symbol, STORE_ID parent)
+{
+    if(store->symbols.parent[symbol] == STORE_NO_ID  &&  parent != symbol)
+        store->symbols.parent[symbol] = parent;
+}
+
+void
+store_register_flags(STORE* store, STORE_ID symbol, unsigned flags)
+{
+    store->symbols.flags[symbol] |= (uint8_t) flags;
+}
+
+void
+store_register_usr(STORE* store, STORE_ID symbol, const char* usr)
+{
+    STORE_ID id;
+
+    if(store->symbols.usr[symbol] != STORE_NO_ID  ||  usr == NULL  ||  usr[0] == '\0')
+        return;
+
+    id = store_intern(store, usr);
+    store->symbols.usr[symbol] = id;
+    if(store_string_owner(store, id) == STORE_NO_ID)
+        store_string_set_owner(store, id, symbol);
+}
+
+/* Append (unresolved) references of the symbol for the caller to fill in
+ * the USRs. Returns index of the first one, or -1 if the symbol has its
+ * references already. */
+static int
+store_alloc_refs(STORE* store, STORE_ID symbol, unsigned n_refs, size_t* p_first)
+{
+    STORE_REF ref = { STORE_NO_ID, STORE_NO_ID };
+    unsigned i;
+
+    if(store->symbols.n_refs[symbol] > 0  ||  n_refs == 0)
+        return -1;
+
+    *p_first = buffer_size(&store->refs) / sizeof(STORE_REF);
+    for(i = 0; i < n_refs; i++)
+        CHECK(buffer_append(&store->refs, &ref, sizeof(STORE_REF)) == 0);
+    store->symbols.first_ref[symbol] = (uint32_t) *p_first;
+    store->symbols.n_refs[symbol] = n_refs;
+    return 0;
 }
 
 void
-store_register_doc(VALUE* item, const char* raw_doc)
+store_register_refs(STORE* store, STORE_ID symbol, const char** usrs, unsigned n_usrs)
 {
-    // TODO
+    size_t first;
+    unsigned i;
+
+    if(store_alloc_refs(store, symbol, n_usrs, &first) != 0)
+        return;
+    for(i = 0; i < n_usrs; i++)
+        store_refs_rw(store)[first + i].usr = store_intern(store, usrs[i]);
 }
 
 void
-store_init(VALUE* store)
+store_link(STORE* store)
 {
-    CHECK(value_init_dict(store) == 0);
+    STORE_REF* refs = store_refs_rw(store);
+    size_t i, n_refs = buffer_size(&store->refs) / sizeof(STORE_REF);
+    size_t n_resolved = 0;
+
+    /* The USR strings know their symbols already, so this is a single sweep
+     * over the references without any lookup. */
+    for(i = 0; i < n_refs; i++) {
+        refs[i].id = store_string_owner(store, refs[i].usr);
+        if(refs[i].id != STORE_NO_ID)
+            n_resolved++;
+    }
+
+    NOTE(1, _("Linked %u of %u references to documented symbols."),
+              (unsigned) n_resolved, (unsigned) n_refs);
 }
 
 void
-store_fini(VALUE* store)
+store_init(STORE* store)
 {
-    value_fini(store);
+    buffer_init(&store->files);
+    memset(&store->symbols, 0, sizeof(STORE_SYMBOLS));
+    buffer_init(&store->strings);
+    buffer_init(&store->refs);
+    htable_init(&store->file_index);
+    htable_init(&store->symbol_index);
+    htable_init(&store->string_index);
+    store->symbol_keys = NULL;
+    store->n_symbol_keys = 0;
+    store->usr_keys = NULL;
+    store->n_usr_keys = 0;
+    store->file_symbols = NULL;
+    store->name_order = NULL;
+    store->kind_order = NULL;
+    memset(store->kind_start, 0, sizeof(store->kind_start));
+    store->merge_mark = NULL;
+    store->n_merge_mark = 0;
+    store->merge_epoch = 0;
+    store->frozen = 0;
+    store->n_intern_hits = 0;
+    store->intern_saved = 0;
+}
+
+void
+store_fini(STORE* store)
+{
+    size_t i;
+
+    if(store->frozen) {
+        free(store->file_symbols);
+    } else {
+        for(i = 0; i < store_file_count(store); i++)
+            free(store_file_rw(store, i)->symbols);
+    }
+
+    buffer_fini(&store->files);
+    store_symbols_fini(&store->symbols);
+    buffer_fini(&store->strings);
+    buffer_fini(&store->refs);
+    htable_fini(&store->file_index, NULL);
+    htable_fini(&store->symbol_index, NULL);
+    htable_fini(&store->string_index, NULL);
+    free(store->symbol_keys);
+    free(store->usr_keys);
+    free(store->name_order);
+    free(store->kind_order);
+    free(store->merge_mark);
+}
+
+/* Approximate size of the heap memory used by the store. */
+static size_t
+store_footprint(const STORE* store)
+{
+    const STORE_SYMBOLS* symbols = &store->symbols;
+    size_t size = 0;
+    size_t i;
+
+    for(i = 0; i < store_file_count(store); i++)
+        size += store_file(store, i)->alloc_symbols * sizeof(STORE_ID);
+    size += store->files.alloc + store->strings.alloc + store->refs.alloc;
+    size += symbols->alloc * (sizeof(*symbols->hash) + sizeof(*symbols->long_name) +
+                sizeof(*symbols->name) + sizeof(*symbols->doc) + sizeof(*symbols->usr) +
+                sizeof(*symbols->loc) + sizeof(*symbols->parent) + sizeof(*symbols->first_ref) +
+                sizeof(*symbols->n_refs) + sizeof(*symbols->kind) + sizeof(*symbols->flags));
+    size += (store->file_index.alloc + store->symbol_index.alloc +
+                store->string_index.alloc) * sizeof(HTABLE_SLOT);
+    size += (store->n_symbol_keys + store->n_usr_keys) * sizeof(STORE_ID);
+    size += store->n_merge_mark * sizeof(uint32_t);
+    return size;
+}
+
+/* Collect string IDs stored in the hash table (those which pass the filter)
+ * into an array sorted by the strings. */
+static STORE_ID*
+store_freeze_index(const STORE* store, const HTABLE* index, int usrs_only,
+                   STORE_SORT* sort, size_t* p_n)
+{
+    STORE_ID* ids;
+    STORE_ID id;
+    size_t i, n = 0;
+
+    for(i = 0; i < index->alloc; i++) {
+        if(index->slots[i].item == NULL)
+            continue;
+        id = STORE_STRING_ITEM_ID(index->slots[i].item);
+        if(usrs_only  &&  store_string_owner(store, id) == STORE_NO_ID)
+            continue;
+        sort[n].key = store_string(store, id);
+        sort[n].kind = 0;
+        sort[n].id = id;
+        n++;
+    }
+    qsort(sort, n, sizeof(STORE_SORT), store_sort_cmp);
+
+    ids = (STORE_ID*) malloc((n > 0 ? n : 1) * sizeof(STORE_ID));
+    CHECK(ids != NULL);
+    for(i = 0; i < n; i++)
+        ids[i] = sort[i].id;
+    *p_n = n;
+    return ids;
+}
+
+void
+store_freeze(STORE* store)
+{
+    STORE_SYMBOLS* symbols = &store->symbols;
+    size_t n_files = store_file_count(store);
+    size_t footprint = store_footprint(store);
+    STORE_SORT* sort;
+    STORE_ID* file_map;
+    STORE_FILE* file;
+    STORE_ID* ids;
+    BUFFER files;
+    BUFFER refs;
+    STORE_LOC loc;
+    size_t i, n, n_sort, n_total;
+    uint32_t j;
+
+    if(store->frozen)
+        return;
+
+    n_sort = n_files;
+    if(n_sort < htable_size(&store->symbol_index))
+        n_sort = htable_size(&store->symbol_index);
+    if(n_sort < htable_size(&store->string_index))
+        n_sort = htable_size(&store->string_index);
+    sort = (STORE_SORT*) malloc((n_sort > 0 ? n_sort : 1) * sizeof(STORE_SORT));
+    file_map = (STORE_ID*) malloc((n_files > 0 ? n_files : 1) * sizeof(STORE_ID));
+    CHECK(sort != NULL  &&  file_map != NULL);
+
+    /* Renumber the files so they are sorted by the path. */
+    for(i = 0; i < n_files; i++) {
+        sort[i].key = store_file_path(store, i);
+        sort[i].kind = 0;
+        sort[i].id = (STORE_ID) i;
+    }
+    qsort(sort, n_files, sizeof(STORE_SORT), store_sort_cmp);
+    buffer_init(&files);
+    CHECK(buffer_reserve(&files, n_files * sizeof(STORE_FILE)) == 0);
+    for(i = 0; i < n_files; i++) {
+        file_map[sort[i].id] = (STORE_ID) i;
+        store_string_set_owner(store, store_file(store, sort[i].id)->path, (STORE_ID) i);
+        CHECK(buffer_append(&files, store_file(store, sort[i].id), sizeof(STORE_FILE)) == 0);
+    }
+    buffer_fini(&store->files);
+    store->files = files;
+    for(i = 0; i < symbols->count; i++) {
+        loc = symbols->loc[i];
+        symbols->loc[i] = STORE_LOC_MAKE(file_map[STORE_LOC_FILE(loc)],
+                                STORE_LOC_LINE(loc), STORE_LOC_COLUMN(loc));
+    }
+
+    /* Pack the lists of symbols of all files into one array, each of them
+     * sorted by the kind and long name (the order of the output). */
+    n_total = 0;
+    for(i = 0; i < n_files; i++)
+        n_total += store_file(store, i)->n_symbols;
+    store->file_symbols = (STORE_ID*) malloc((n_total > 0 ? n_total : 1) * sizeof(STORE_ID));
+    CHECK(store->file_symbols != NULL);
+    ids = store->file_symbols;
+    for(i = 0; i < n_files; i++) {
+        file = store_file_rw(store, i);
+        for(j = 0; j < file->n_symbols; j++) {
+            sort[j].key = store_symbol_long_name(store, file->symbols[j]);
+            sort[j].kind = symbols->kind[file->symbols[j]];
+            sort[j].id = file->symbols[j];
+        }
+        qsort(sort, file->n_symbols, sizeof(STORE_SORT), store_sort_cmp);
+        for(j = 0; j < file->n_symbols; j++)
+            ids[j] = sort[j].id;
+        free(file->symbols);
+        file->symbols = ids;
+        file->alloc_symbols = file->n_symbols;
+        ids += file->n_symbols;
+    }
+
+    /* Replace the hash tables with sorted arrays. */
+    store->symbol_keys = store_freeze_index(store, &store->symbol_index, 0, sort, &store->n_symbol_keys);
+    store->usr_keys = store_freeze_index(store, &store->string_index, 1, sort, &store->n_usr_keys);
+    htable_fini(&store->file_index, NULL);
+    htable_init(&store->file_index);
+    htable_fini(&store->symbol_index, NULL);
+    htable_init(&store->symbol_index);
+    htable_fini(&store->string_index, NULL);
+    htable_init(&store->string_index);
+
+    /* Drop references of records beaten in store_merge(). */
+    buffer_init(&refs);
+    CHECK(buffer_reserve(&refs, buffer_size(&store->refs)) == 0);
+    for(i = 0; i < symbols->count; i++) {
+        n = symbols->n_refs[i];
+        if(n == 0)
+            continue;
+        CHECK(buffer_append(&refs, (const STORE_REF*) store->refs.data + symbols->first_ref[i],
+                    n * sizeof(STORE_REF)) == 0);
+        symbols->first_ref[i] = (uint32_t) (buffer_size(&refs) / sizeof(STORE_REF) - n);
+    }
+    buffer_fini(&store->refs);
+    store->refs = refs;
+
+    /* Get rid of all the spare capacity. */
+    buffer_shrink(&store->refs);
+    buffer_shrink(&store->strings);
+    if(symbols->count > 0)
+        store_symbols_realloc(symbols, symbols->count);
+    free(store->merge_mark);
+    store->merge_mark = NULL;
+    store->n_merge_mark = 0;
+
+    free(file_map);
+    free(sort);
+    store->frozen = 1;
+
+    NOTE(1, _("Froze the store: %u KB -> %u KB."), (unsigned) (footprint / 1024),
+              (unsigned) (store_footprint(store) / 1024));
+}
+
+/* Sorting symbols by name, with ties broken by the long name (so the order
+ * does not depend on the symbol IDs, i.e. on the order of merging). */
+typedef struct STORE_NAME_SORT {
+    const char* name;
+    const char* long_name;
+    STORE_ID id;
+} STORE_NAME_SORT;
+
+static int
+store_name_sort_cmp(const void* a, const void* b)
+{
+    const STORE_NAME_SORT* sa = (const STORE_NAME_SORT*) a;
+    const STORE_NAME_SORT* sb = (const STORE_NAME_SORT*) b;
+    int cmp;
+
+    cmp = strcmp(sa->name, sb->name);
+    if(cmp == 0)
+        cmp = strcmp(sa->long_name, sb->long_name);
+    return cmp;
+}
+
+static void
+store_build_name_order(STORE* store)
+{
+    size_t i, n = store_symbol_count(store);
+    STORE_NAME_SORT* sort;
+
+    sort = (STORE_NAME_SORT*) malloc((n > 0 ? n : 1) * sizeof(STORE_NAME_SORT));
+    store->name_order = (STORE_ID*) malloc((n > 0 ? n : 1) * sizeof(STORE_ID));
+    CHECK(sort != NULL  &&  store->name_order != NULL);
+
+    for(i = 0; i < n; i++) {
+        sort[i].name = store_symbol_name(store, i);
+        sort[i].long_name = store_symbol_long_name(store, i);
+        sort[i].id = (STORE_ID) i;
+    }
+    qsort(sort, n, sizeof(STORE_NAME_SORT), store_name_sort_cmp);
+    for(i = 0; i < n; i++)
+        store->name_order[i] = sort[i].id;
+
+    free(sort);
+}
+
+static void
+store_build_kind_order(STORE* store)
+{
+    size_t i, n = store_symbol_count(store);
+    STORE_SORT* sort;
+    unsigned kind;
+
+    sort = (STORE_SORT*) malloc((n > 0 ? n : 1) * sizeof(STORE_SORT));
+    store->kind_order = (STORE_ID*) malloc((n > 0 ? n : 1) * sizeof(STORE_ID));
+    CHECK(sort != NULL  &&  store->kind_order != NULL);
+
+    for(i = 0; i < n; i++) {
+        sort[i].key = store_symbol_long_name(store, i);
+        sort[i].kind = store_symbol_kind(store, i);
+        sort[i].id = (STORE_ID) i;
+    }
+    qsort(sort, n, sizeof(STORE_SORT), store_sort_cmp);
+
+    /* kind_start[k] is where kind k starts; kind_start[k+1] where it ends. */
+    memset(store->kind_start, 0, sizeof(store->kind_start));
+    for(i = 0; i < n; i++) {
+        store->kind_order[i] = sort[i].id;
+        if(sort[i].kind <= STORE_KIND_MAX)
+            store->kind_start[sort[i].kind + 1]++;
+    }
+    for(kind = 1; kind <= STORE_KIND_MAX + 1; kind++)
+        store->kind_start[kind] += store->kind_start[kind - 1];
+
+    free(sort);
+}
+
+/* Index of the first symbol in the name_order whose name is not below (or,
+ * if `upper`, is above) the `str`, comparing at most `len` characters. */
+static size_t
+store_name_bound(const STORE* store, const char* str, size_t len, int upper)
+{
+    size_t lo = 0;
+    size_t hi = store_symbol_count(store);
+    size_t mid;
+    int cmp;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = strncmp(store_symbol_name(store, store->name_order[mid]), str, len);
+        if(cmp < 0  ||  (upper  &&  cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static size_t
+store_query_names(STORE* store, const char* str, size_t len, const STORE_ID** p_ids)
+{
+    size_t first, end;
+
+    CHECK(store->frozen);
+    if(store->name_order == NULL)
+        store_build_name_order(store);
+
+    first = store_name_bound(store, str, len, 0);
+    end = store_name_bound(store, str, len, 1);
+    *p_ids = store->name_order + first;
+    return end - first;
+}
+
+size_t
+store_query_name(STORE* store, const char* name, const STORE_ID** p_ids)
+{
+    /* Compare including the terminator so longer names do not match. */
+    return store_query_names(store, name, strlen(name) + 1, p_ids);
+}
+
+size_t
+store_query_prefix(STORE* store, const char* prefix, const STORE_ID** p_ids)
+{
+    return store_query_names(store, prefix, strlen(prefix), p_ids);
+}
+
+size_t
+store_query_kind(STORE* store, unsigned kind, const STORE_ID** p_ids)
+{
+    CHECK(store->frozen);
+    if(store->kind_order == NULL)
+        store_build_kind_order(store);
+
+    if(kind > STORE_KIND_MAX) {
+        *p_ids = store->kind_order;
+        return 0;
+    }
+    *p_ids = store->kind_order + store->kind_start[kind];
+    return store->kind_start[kind + 1] - store->kind_start[kind];
+}
+
+size_t
+store_query_file(const STORE* store, STORE_ID file, const STORE_ID** p_ids)
+{
+    CHECK(store->frozen);
+
+    /* The freezing has sorted and packed these already. */
+    *p_ids = store_file(store, file)->symbols;
+    return store_file(store, file)->n_symbols;
+}
+
+
+void
+store_report(const STORE* store)
+{
+    NOTE(1, _("Store: %u files, %u symbols, %u KB of strings; interning saved %u KB "
+              "(%u duplicate strings)."),
+              (unsigned) store_file_count(store), (unsigned) store_symbol_count(store),
+              (unsigned) (buffer_size(&store->strings) / 1024),
+              (unsigned) (store->intern_saved / 1024), (unsigned) store->n_intern_hits);
+}
+
+/* Decide which of two records of the same symbol survives a merge. So that
+ * the result does not depend on the order the parts are merged in (i.e. on
+ * the scheduling of the parser workers), this is a total order: the record
+ * with a documentation wins, then the one of a definition, then the one
+ * from the file with the smaller path, then the one declared earlier in the
+ * file. Returns non-zero if record `a_id` of store `a` beats record `b_id`
+ * of store `b`. */
+static int
+store_symbol_beats(const STORE* a, STORE_ID a_id, const STORE* b, STORE_ID b_id)
+{
+    STORE_LOC a_loc = a->symbols.loc[a_id];
+    STORE_LOC b_loc = b->symbols.loc[b_id];
+    int a_doc = (a->symbols.doc[a_id] != STORE_NO_ID);
+    int b_doc = (b->symbols.doc[b_id] != STORE_NO_ID);
+    int a_def = ((a->symbols.flags[a_id] & STORE_FLAG_DEFINITION) != 0);
+    int b_def = ((b->symbols.flags[b_id] & STORE_FLAG_DEFINITION) != 0);
+    int cmp;
+
+    if(a_doc != b_doc)
+        return a_doc;
+    if(a_def != b_def)
+        return a_def;
+    cmp = strcmp(store_file_path(a, STORE_LOC_FILE(a_loc)), store_file_path(b, STORE_LOC_FILE(b_loc)));
+    if(cmp != 0)
+        return (cmp < 0);
+    if(STORE_LOC_LINE(a_loc) != STORE_LOC_LINE(b_loc))
+        return (STORE_LOC_LINE(a_loc) < STORE_LOC_LINE(b_loc));
+    if(STORE_LOC_COLUMN(a_loc) != STORE_LOC_COLUMN(b_loc))
+        return (STORE_LOC_COLUMN(a_loc) < STORE_LOC_COLUMN(b_loc));
+    return (strcmp(store_symbol_long_name(a, a_id), store_symbol_long_name(b, b_id)) < 0);
+}
+
+/* Make the long name a key of the symbol (if it is not a key already). This
+ * happens when the same USR comes under another long name (e.g. parameter
+ * types spelled differently): all the names stay keys of the symbol. Returns
+ * string ID of the key. */
+static STORE_ID
+store_add_key(STORE* store, STORE_ID sym_id, const char* long_name, uint64_t hash)
+{
+    STORE_KEY key = { store, long_name };
+    void* item;
+    STORE_ID id;
+
+    item = htable_lookup(&store->symbol_index, hash, store_string_cmp, &key);
+    if(item != NULL)
+        return STORE_STRING_ITEM_ID(item);
+
+    id = store_string_add(store, sym_id, long_name);
+    CHECK(htable_insert(&store->symbol_index, hash, STORE_STRING_ITEM(id)) == 0);
+    return id;
+}
+
+/* Replace all attributes of the symbol (except the parent) with those of the
+ * record `id` of the `part`. */
+static void
+store_merge_symbol(STORE* store, STORE_ID sym_id, const STORE* part, STORE_ID id,
+                   const STORE_ID* file_map)
+{
+    STORE_SYMBOLS* symbols = &store->symbols;
+    const char* long_name = store_symbol_long_name(part, id);
+    uint64_t hash = part->symbols.hash[id];
+    STORE_LOC loc = part->symbols.loc[id];
+    const STORE_REF* refs;
+    size_t first;
+    unsigned n;
+
+    if(strcmp(store_symbol_long_name(store, sym_id), long_name) != 0) {
+        symbols->long_name[sym_id] = store_add_key(store, sym_id, long_name, hash);
+        symbols->hash[sym_id] = hash;
+    }
+
+    symbols->name[sym_id] = store_intern(store, store_symbol_name(part, id));
+    symbols->flags[sym_id] = part->symbols.flags[id];
+    symbols->doc[sym_id] = STORE_NO_ID;
+    store_register_doc(store, sym_id, store_symbol_doc(part, id));
+    symbols->usr[sym_id] = STORE_NO_ID;
+    store_register_usr(store, sym_id, store_symbol_usr(part, id));
+    symbols->loc[sym_id] = STORE_LOC_MAKE(file_map[STORE_LOC_FILE(loc)],
+                                STORE_LOC_LINE(loc), STORE_LOC_COLUMN(loc));
+
+    /* (References of the beaten record are left behind in the array.) */
+    symbols->n_refs[sym_id] = 0;
+    refs = store_symbol_refs(part, id, &n);
+    if(store_alloc_refs(store, sym_id, n, &first) == 0) {
+        while(n-- > 0)
+            store_refs_rw(store)[first + n].usr = store_intern(store, store_string(part, refs[n].usr));
+    }
+}
+
+/* Get the mark array covering all symbols of the store. It is kept across
+ * merges (growing with the store), so a merge costs time proportional to
+ * the part, not to the whole store. */
+static uint32_t*
+store_merge_mark(STORE* store)
+{
+    size_t n = store_symbol_count(store);
+    size_t alloc;
+    uint32_t* mark;
+
+    if(n > store->n_merge_mark) {
+        alloc = (store->n_merge_mark > 0 ? store->n_merge_mark : 64);
+        while(alloc < n)
+            alloc *= 2;
+        mark = (uint32_t*) realloc(store->merge_mark, alloc * sizeof(uint32_t));
+        CHECK(mark != NULL);
+        memset(mark + store->n_merge_mark, 0, (alloc - store->n_merge_mark) * sizeof(uint32_t));
+        store->merge_mark = mark;
+        store->n_merge_mark = alloc;
+    }
+    return store->merge_mark;
+}
+
+/* Start a new epoch of the marks: Nothing is marked with it yet. */
+static uint32_t
+store_merge_epoch(STORE* store)
+{
+    if(store->merge_epoch == UINT32_MAX) {
+        memset(store->merge_mark, 0, store->n_merge_mark * sizeof(uint32_t));
+        store->merge_epoch = 0;
+    }
+    return ++store->merge_epoch;
+}
+
+void
+store_merge(STORE* store, STORE* part)
+{
+    const STORE_SYMBOLS* symbols = &part->symbols;
+    size_t n_part_files = store_file_count(part);
+    size_t n_old_files = store_file_count(store);
+    const STORE_FILE* file;
+    const STORE_FILE* old;
+    STORE_ID* file_map;
+    STORE_ID* sym_map;
+    uint32_t* mark;
+    uint8_t* won;
+    STORE_ID sym_id;
+    STORE_ID parent;
+    STORE tmp;
+    size_t i;
+    uint32_t j;
+    uint32_t epoch;
+
+    CHECK(!store->frozen);
+    /* Merging into an empty store is trivial. (This is the common case of
+     * the first part.) */
+    if(n_old_files == 0  &&  store_symbol_count(store) == 0) {
+        tmp = *store;
+        *store = *part;
+        *part = tmp;
+        return;
+    }
+
+    CHECK(htable_reserve(&store->file_index, htable_size(&store->file_index) + n_part_files) == 0);
+    CHECK(htable_reserve(&store->symbol_index, htable_size(&store->symbol_index) + symbols->count) == 0);
+    CHECK(htable_reserve(&store->string_index, htable_size(&store->string_index) + htable_size(&part->string_index)) == 0);
+
+    file_map = (STORE_ID*) malloc((n_part_files + 1) * sizeof(STORE_ID));
+    sym_map = (STORE_ID*) malloc((symbols->count + 1) * sizeof(STORE_ID));
+    won = (uint8_t*) calloc(symbols->count + 1, sizeof(uint8_t));
+    CHECK(file_map != NULL  &&  sym_map != NULL  &&  won != NULL);
+
+    for(i = 0; i < n_part_files; i++) {
+        file = store_file(part, i);
+        file_map[i] = store_register_file_(store, store_file_path(part, i), file->hash, file);
+    }
+
+    /* Map each symbol of the part to a symbol of the store. Declarations
+     * of the same entity are recognized by the USR first (if there is one),
+     * and by the long name otherwise. Each lookup is O(1), so the whole
+     * merge is linear in the number of symbols. */
+    for(i = 0; i < symbols->count; i++) {
+        sym_id = STORE_NO_ID;
+        if(symbols->usr[i] != STORE_NO_ID) {
+            sym_id = store_lookup_usr(store, store_symbol_usr(part, i));
+            if(sym_id != STORE_NO_ID)
+                store_add_key(store, sym_id, store_symbol_long_name(part, i), symbols->hash[i]);
+        }
+        if(sym_id == STORE_NO_ID)
+            sym_id = store_lookup_symbol_(store, store_symbol_long_name(part, i), symbols->hash[i]);
+
+        if(sym_id == STORE_NO_ID) {
+            sym_id = store_symbol_new(store, file_map[STORE_LOC_FILE(symbols->loc[i])],
+                        symbols->kind[i], store_symbol_name(part, i),
+                        store_symbol_long_name(part, i), symbols->hash[i]);
+            won[i] = 1;
+        } else {
+            won[i] = (uint8_t) store_symbol_beats(part, i, store, sym_id);
+        }
+
+        if(won[i])
+            store_merge_symbol(store, sym_id, part, i, file_map);
+        sym_map[i] = sym_id;
+    }
+
+    /* Now all the parents have their IDs in the store. */
+    for(i = 0; i < symbols->count; i++) {
+        if(!won[i])
+            continue;
+        parent = symbols->parent[i];
+        parent = (parent != STORE_NO_ID ? sym_map[parent] : STORE_NO_ID);
+        store->symbols.parent[sym_map[i]] = (parent != sym_map[i] ? parent : STORE_NO_ID);
+    }
+
+    /* Add the symbols into the files. A symbol may be already listed in a
+     * file the store knew before; or more symbols of the part may have
+     * become one. Marking the listed symbols (with a new epoch for each
+     * file) catches both, without any scanning of the lists. */
+    mark = store_merge_mark(store);
+    for(i = 0; i < n_part_files; i++) {
+        file = store_file(part, i);
+        epoch = store_merge_epoch(store);
+        if(file_map[i] < n_old_files) {
+            old = store_file(store, file_map[i]);
+            for(j = 0; j < old->n_symbols; j++)
+                mark[old->symbols[j]] = epoch;
+        }
+        for(j = 0; j < file->n_symbols; j++) {
+            sym_id = sym_map[file->symbols[j]];
+            if(mark[sym_id] != epoch) {
+                mark[sym_id] = epoch;
+                store_file_add_symbol(store, file_map[i], sym_id);
+            }
+        }
+    }
+
+    free(won);
+    free(sym_map);
+    free(file_map);
+}
+
+static const char*
+store_kind_name(unsigned kind)
+{
+    switch(kind) {
+        case STORE_KIND_FUNCTION:   return "functions";
+        case STORE_KIND_TYPE:       return "types";
+        default:                    return "unknown";
+    }
+}
+
+void
+store_export(const STORE* store, VALUE* root)
+{
+    const STORE_SYMBOLS* symbols = &store->symbols;
+    const STORE_FILE* file;
+    const STORE_REF* refs;
+    VALUE* files;
+    VALUE* val_file;
+    VALUE* val_sym;
+    VALUE* val_refs;
+    STORE_ID id;
+    size_t i;
+    uint32_t j;
+    unsigned k, n_refs;
+
+    CHECK(value_init_dict(root) == 0);
+    files = value_dict_add(root, "files");
+    CHECK(files != NULL);
+    CHECK(value_init_dict(files) == 0);
+
+    for(i = 0; i < store_file_count(store); i++) {
+        file = store_file(store, i);
+        val_file = value_dict_add(files, store_file_path(store, i));
+        CHECK(val_file != NULL);
+        CHECK(value_init_dict(val_file) == 0);
+
+        for(j = 0; j < file->n_symbols; j++) {
+            id = file->symbols[j];
+            val_sym = value_dict_get_or_add(val_file, store_kind_name(symbols->kind[id]));
+            CHECK(val_sym != NULL);
+            if(value_is_new(val_sym))
+                CHECK(value_init_dict(val_sym) == 0);
+            val_sym = value_dict_add(val_sym, store_symbol_long_name(store, id));
+            CHECK(val_sym != NULL);
+            CHECK(value_init_dict(val_sym) == 0);
+
+            CHECK(value_init_string(value_dict_add(val_sym, "name"), store_symbol_name(store, id)) == 0);
+            CHECK(value_init_string(value_dict_add(val_sym, "long_name"), store_symbol_long_name(store, id)) == 0);
+            if(symbols->doc[id] != STORE_NO_ID)
+                CHECK(value_init_string(value_dict_add(val_sym, "doc"), store_symbol_doc(store, id)) == 0);
+            if(STORE_LOC_LINE(symbols->loc[id]) != 0) {
+                CHECK(value_init_uint32(value_dict_add(val_sym, "line"), STORE_LOC_LINE(symbols->loc[id])) == 0);
+                CHECK(value_init_uint32(value_dict_add(val_sym, "column"), STORE_LOC_COLUMN(symbols->loc[id])) == 0);
+            }
+            if(STORE_LOC_FILE(symbols->loc[id]) != i)
+                CHECK(value_init_string(value_dict_add(val_sym, "file"),
+                            store_file_path(store, STORE_LOC_FILE(symbols->loc[id]))) == 0);
+            if(symbols->parent[id] != STORE_NO_ID)
+                CHECK(value_init_string(value_dict_add(val_sym, "parent"), store_symbol_long_name(store, symbols->parent[id])) == 0);
+            if(symbols->flags[id] & STORE_FLAG_DEFINITION)
+                CHECK(value_init_bool(value_dict_add(val_sym, "definition"), 1) == 0);
+            if(symbols->usr[id] != STORE_NO_ID)
+                CHECK(value_init_string(value_dict_add(val_sym, "usr"), store_symbol_usr(store, id)) == 0);
+            if(symbols->n_refs[id] > 0) {
+                val_refs = value_dict_add(val_sym, "refs");
+                CHECK(val_refs != NULL);
+                CHECK(value_init_array(val_refs) == 0);
+                refs = store_symbol_refs(store, id, &n_refs);
+                for(k = 0; k < n_refs; k++)
+                    CHECK(value_init_string(value_array_append(val_refs), store_string(store, refs[k].usr)) == 0);
+            }
+        }
+    }
+}
+
+static const char*
+store_import_string(const VALUE* dict, const char* key)
+{
+    const VALUE* v = value_dict_get(dict, key);
+    return (v != NULL  &&  value_type(v) == VALUE_STRING ? value_string(v) : NULL);
+}
+
+/* What can be resolved only when all the files are imported. */
+typedef struct STORE_IMPORT_FIXUP {
+    STORE_ID id;
+    const char* file;           /* The file the location belongs to. */
+    const char* parent;
+} STORE_IMPORT_FIXUP;
+
+typedef struct STORE_IMPORT {
+    STORE* store;
+    STORE_ID file;
+    unsigned kind;
+    const char* name;
+    BUFFER fixups;              /* STORE_IMPORT_FIXUP[] */
+} STORE_IMPORT;
+
+static void
+store_import_refs(STORE* store, STORE_ID id, const VALUE* refs)
+{
+    STORE_REF* r;
+    const VALUE* ref;
+    size_t i, n, first;
+    unsigned n_usrs = 0;
+
+    if(refs == NULL  ||  value_type(refs) != VALUE_ARRAY)
+        return;
+
+    n = value_array_size(refs);
+    for(i = 0; i < n; i++) {
+        if(value_type(value_array_get(refs, i)) == VALUE_STRING)
+            n_usrs++;
+    }
+
+    if(store_alloc_refs(store, id, n_usrs, &first) != 0)
+        return;
+    for(i = 0; i < n; i++) {
+        ref = value_array_get(refs, i);
+        if(value_type(ref) == VALUE_STRING) {
+            r = store_refs_rw(store) + first++;
+            r->usr = store_intern(store, value_string(ref));
+        }
+    }
+}
+
+static int
+store_import_symbol(const VALUE* key, VALUE* val, void* ctx)
+{
+    STORE_IMPORT* import = (STORE_IMPORT*) ctx;
+    STORE_IMPORT_FIXUP fixup;
+    const char* name;
+    const char* long_name;
+    const VALUE* v;
+    uint32_t line, column;
+    STORE_ID id;
+
+    if(value_type(val) != VALUE_DICT) {
+        ERROR(_("%s: Malformed store (symbol %s is not an object)."), import->name, value_string(key));
+        return -1;
+    }
+
+    long_name = store_import_string(val, "long_name");
+    if(long_name == NULL)
+        long_name = value_string(key);
+    name = store_import_string(val, "name");
+    if(name == NULL)
+        name = long_name;
+
+    id = store_register_symbol(import->store, import->file, import->kind, name, long_name);
+    store_register_doc(import->store, id, store_import_string(val, "doc"));
+    store_register_usr(import->store, id, store_import_string(val, "usr"));
+    store_import_refs(import->store, id, value_dict_get(val, "refs"));
+
+    v = value_dict_get(val, "line");
+    if(v != NULL  &&  value_is_compatible(v, VALUE_UINT32)) {
+        line = value_uint32(v);
+        v = value_dict_get(val, "column");
+        column = (v != NULL  &&  value_is_compatible(v, VALUE_UINT32) ? value_uint32(v) : 0);
+        store_register_location(import->store, id, line, column);
+    }
+    v = value_dict_get(val, "definition");
+    if(v != NULL  &&  value_type(v) == VALUE_BOOL  &&  value_bool(v))
+        store_register_flags(import->store, id, STORE_FLAG_DEFINITION);
+
+    /* A symbol is listed in all files declaring it, but its location is
+     * from one of them (which may come later); and the parent may live in
+     * another file too. */
+    fixup.id = id;
+    fixup.file = store_import_string(val, "file");
+    fixup.parent = store_import_string(val, "parent");
+    if(fixup.file != NULL  ||  fixup.parent != NULL)
+        CHECK(buffer_append(&import->fixups, &fixup, sizeof(STORE_IMPORT_FIXUP)) == 0);
+    return 0;
+}
+
+static int
+store_import_file(const VALUE* key, VALUE* val, void* ctx)
+{
+    static const unsigned kinds[] = { STORE_KIND_FUNCTION, STORE_KIND_TYPE };
+    STORE_IMPORT* import = (STORE_IMPORT*) ctx;
+    const VALUE* symbols;
+    size_t i;
+
+    if(value_type(val) != VALUE_DICT) {
+        ERROR(_("%s: Malformed store (file %s is not an object)."), import->name, value_string(key));
+        return -1;
+    }
+
+    import->file = store_register_file(import->store, value_string(key));
+    for(i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        symbols = value_dict_get(val, store_kind_name(kinds[i]));
+        if(symbols == NULL  ||  value_type(symbols) != VALUE_DICT)
+            continue;
+        import->kind = kinds[i];
+        if(value_dict_walk_sorted(symbols, store_import_symbol, import) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int
+store_import(STORE* store, const VALUE* root, const char* name)
+{
+    STORE_IMPORT import = { store, STORE_NO_ID, 0, name, BUFFER_INITIALIZER };
+    const STORE_IMPORT_FIXUP* fixup;
+    const VALUE* files;
+    STORE_LOC* loc;
+    STORE_ID file;
+    size_t i, n;
+
+    files = value_dict_get(root, "files");
+    if(files == NULL)
+        return 0;
+    if(value_type(files) != VALUE_DICT) {
+        ERROR(_("%s: Malformed store (\"files\" is not an object)."), name);
+        return -1;
+    }
+
+    if(value_dict_walk_sorted(files, store_import_file, &import) != 0) {
+        buffer_fini(&import.fixups);
+        return -1;
+    }
+
+    fixup = (const STORE_IMPORT_FIXUP*) import.fixups.data;
+    n = buffer_size(&import.fixups) / sizeof(STORE_IMPORT_FIXUP);
+    for(i = 0; i < n; i++) {
+        if(fixup[i].file != NULL) {
+            file = store_lookup_file(store, fixup[i].file);
+            loc = &store->symbols.loc[fixup[i].id];
+            if(file != STORE_NO_ID)
+                *loc = STORE_LOC_MAKE(file, STORE_LOC_LINE(*loc), STORE_LOC_COLUMN(*loc));
+        }
+        if(fixup[i].parent != NULL)
+            store_register_parent(store, fixup[i].id, store_lookup_symbol(store, fixup[i].parent));
+    }
+    buffer_fini(&import.fixups);
+    return 0;
+}
+
+static void
+store_json_config(JSON_CONFIG* config)
+{
+    /* The store may be huge. Lift all the limits designed for untrusted
+     * input and just make sure the root is an object. */
+    json_default_config(config);
+    config->max_total_len = 0;
+    config->max_number_len = 0;
+    config->max_string_len = 0;
+    config->max_key_len = 0;
+    config->max_nesting_level = 0;
+    config->flags = JSON_NOSCALARROOT | JSON_NOARRAYASROOT;
+}
+
+int
+store_read_json(const char* path, VALUE* p_root)
+{
+    char buffer[64 * 1024];
+    JSON_DOM_PARSER parser;
+    JSON_CONFIG config;
+    JSON_INPUT_POS pos;
+    size_t n;
+    FILE* f;
+    int err = 0;
+
+    f = fopen(path, "rb");
+    if(f == NULL) {
+        ERROR("%s (%s)", strerror(errno), path);
+        return -1;
+    }
+
+    store_json_config(&config);
+    CHECK(json_dom_init(&parser, &config, 0) == 0);
+    while(err == 0) {
+        n = fread(buffer, 1, sizeof(buffer), f);
+        if(n == 0)
+            break;
+        err = json_dom_feed(&parser, buffer, n);
+    }
+    if(ferror(f)) {
+        ERROR("%s (%s)", strerror(errno), path);
+        json_dom_fini(&parser, p_root, NULL);
+        value_fini(p_root);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    err = json_dom_fini(&parser, p_root, &pos);
+    if(err != 0) {
+        ERROR(_("%s:%u:%u: Malformed store (JSON error %d)."), path,
+                pos.line_number, pos.column_number, err);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+store_parse_json(const char* data, size_t size, const char* name, VALUE* p_root)
+{
+    JSON_CONFIG config;
+    JSON_INPUT_POS pos;
+    int err;
+
+    store_json_config(&config);
+    err = json_dom_parse(data, size, &config, 0, p_root, &pos);
+    if(err != 0) {
+        ERROR(_("%s:%u:%u: Malformed store (JSON error %d)."), name,
+                pos.line_number, pos.column_number, err);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+store_load_json(STORE* store, const char* path)
+{
+    STORE part;
+    VALUE root;
+    int ret;
+
+    if(store_read_json(path, &root) != 0)
+        return -1;
+
+    /* Import into a store of its own and merge it, so symbols the `store`
+     * knows already are resolved the same way as when merging the results
+     * of the parser. */
+    store_init(&part);
+    ret = store_import(&part, &root, path);
+    value_fini(&root);
+    if(ret == 0)
+        store_merge(store, &part);
+    store_fini(&part);
+    return ret;
 }
@@ -27,22 +27,338 @@
 #define DOCBAKER_STORE_H
 
 #include "misc.h"
+#include "buffer.h"
+#include "htable.h"
 #include "value.h"
 
 
-/* These functions create new (empty) VALUE corresponding to the given
- * entity, add it into the store, and return the new VALUE, without
- * increasing a ref. count. If the caller wants to keep the value fir his
- * own purposes for possibly longer time then the store's existence, he should
- * gc_ref() it. */
+/* The store is the database of everything the parser has found in the
+ * sources.
+ *
+ * Files and symbols live in flat tables and they refer to each other by
+ * their index in the table (STORE_ID). Each symbol is registered under a key
+ * (its fully qualified long name, e.g. "ns::foo(int, char *)"), so the same
+ * symbol declared in more files (or parsed from more translation units) is
+ * stored only once. Hash tables keyed by fnv1a_64() of the path or of the
+ * key make both registration and lookup O(1).
+ *
+ * Each file also keeps the list of IDs of all symbols declared in it, and
+ * what the file looked like on the disk when it has been registered.
+ *
+ * Where a symbol is declared is a STORE_LOC, a single 64-bit integer packing
+ * the file ID, line and column, in this order from the most significant
+ * bits. So sorting symbols by location, or grouping them by file, is just an
+ * integer comparison.
+ *
+ * The symbol table is stored by columns (one array per attribute, all
+ * indexed by the symbol ID), so passes over all symbols which need only one
+ * or two attributes (e.g. the kind) read just those and sweep the memory
+ * sequentially.
+ *
+ * All strings the symbols refer to (and the file paths) live in one string
+ * table and symbols refer to them by their ID (i.e. their offset in the
+ * table) too. Strings which tend to repeat a lot (short names of overloaded
+ * functions and methods, copy-pasted doc comments, USRs of commonly used
+ * types) are interned: each distinct string is stored only once, so two
+ * interned strings are equal if and only if their IDs are.
+ *
+ * Symbols also remember their USR (the unified symbol resolution string of
+ * libclang, which identifies the entity across translation units) and the
+ * USRs of types they refer to. Each interned USR remembers the symbol it
+ * belongs to, so once everything is registered, store_link() resolves all
+ * the references to symbol IDs in one pass, and generators can follow them
+ * in O(1).
+ *
+ * Once the store is complete, store_freeze() makes it read-only and compact:
+ * the files get sorted by path, lists of their symbols get sorted in the
+ * order of the output and packed into one array, and the hash tables are
+ * replaced by sorted arrays searched by bisection. Generators work with the
+ * frozen store.
+ *
+ * The store is saved (and cached) as JSON of this shape:
+ *
+ *   { "files": { <path>: { "functions"|"types": { <long name>: {
+ *          "name": ..., "long_name": ..., "doc": ..., "line": ..., "column": ...,
+ *          "file": <path>, "parent": <long name>, "definition": true,
+ *          "usr": ..., "refs": [ <usr>, ... ]
+ *   } } } } }
+ *
+ * A symbol declared in more files is listed in each of them; "file" tells
+ * which of them the "line" and "column" belong to (if not the one it is
+ * listed in).
+ *
+ * See store_export() and store_import().
+ */
+
+
+typedef uint32_t STORE_ID;
+
+#define STORE_NO_ID             ((STORE_ID) 0xffffffff)
+
+/* Packed source location: 24 bits of file ID, 24 bits of line and 16 bits
+ * of column. (Line and column saturate; zero means unknown.) */
+typedef uint64_t STORE_LOC;
+
+#define STORE_MAX_FILES         (1U << 24)
+#define STORE_MAX_LINE          0xffffffU
+#define STORE_MAX_COLUMN        0xffffU
+
+#define STORE_LOC_MAKE(file, line, column)                                  \
+        (((STORE_LOC) (file) << 40) |                                       \
+         ((STORE_LOC) ((line) < STORE_MAX_LINE ? (line) : STORE_MAX_LINE) << 16) |  \
+         (STORE_LOC) ((column) < STORE_MAX_COLUMN ? (column) : STORE_MAX_COLUMN))
+
+#define STORE_LOC_FILE(loc)     ((STORE_ID) ((loc) >> 40))
+#define STORE_LOC_LINE(loc)     ((uint32_t) ((loc) >> 16) & STORE_MAX_LINE)
+#define STORE_LOC_COLUMN(loc)   ((uint32_t) (loc) & STORE_MAX_COLUMN)
+
+/* Symbol kinds. */
+#define STORE_KIND_FUNCTION     1
+#define STORE_KIND_TYPE         2   /* struct, union, enum, class, typedef */
+#define STORE_KIND_MAX          2
+
+/* Symbol flags. */
+#define STORE_FLAG_DEFINITION   0x01    /* Seen the definition (not just a declaration). */
+
+
+typedef struct STORE_FILE {
+    STORE_ID path;              /* String ID */
+    uint64_t hash;              /* fnv1a_64() of the path */
+    uint64_t size;              /* Size and mtime when registered (or zero */
+    int64_t mtime;              /* if the file cannot be stat()-ed). */
+    STORE_ID* symbols;          /* Symbols declared in the file. (Sorted by
+                                 * kind and long name if frozen.) */
+    uint32_t n_symbols;
+    uint32_t alloc_symbols;
+} STORE_FILE;
+
+typedef struct STORE_REF {
+    STORE_ID usr;               /* String ID */
+    STORE_ID id;                /* Resolved by store_link(), or STORE_NO_ID. */
+} STORE_REF;
+
+/* The symbol table. All the arrays are indexed by the symbol ID. Strings are
+ * IDs into the string table (or STORE_NO_ID if the symbol has none). */
+typedef struct STORE_SYMBOLS {
+    uint64_t* hash;             /* fnv1a_64() of the key (i.e. long name) */
+    STORE_ID* long_name;
+    STORE_ID* name;
+    STORE_ID* doc;
+    STORE_ID* usr;
+    STORE_LOC* loc;             /* Where the symbol is declared. */
+    STORE_ID* parent;           /* Enclosing symbol (e.g. a struct) or STORE_NO_ID. */
+    uint32_t* first_ref;        /* Index into STORE::refs. */
+    uint32_t* n_refs;
+    uint8_t* kind;
+    uint8_t* flags;
+    size_t count;
+    size_t alloc;
+} STORE_SYMBOLS;
+
+typedef struct STORE {
+    BUFFER files;               /* STORE_FILE[] */
+    STORE_SYMBOLS symbols;
+    BUFFER strings;             /* String table (NUL-terminated strings) */
+    BUFFER refs;                /* STORE_REF[] (types the symbols refer to) */
+    HTABLE file_index;          /* path --> ID */
+    HTABLE symbol_index;        /* long_name --> ID */
+    HTABLE string_index;        /* Interned strings (and USR --> ID). */
+    STORE_ID* symbol_keys;      /* Long names (string IDs) sorted; replaces */
+    size_t n_symbol_keys;       /* symbol_index when frozen. */
+    STORE_ID* usr_keys;         /* USRs (string IDs) sorted; replaces */
+    size_t n_usr_keys;          /* string_index when frozen. */
+    STORE_ID* file_symbols;     /* All STORE_FILE::symbols when frozen. */
+    STORE_ID* name_order;       /* Query indexes (built on first use): */
+    STORE_ID* kind_order;       /* Symbols sorted by name; by kind and long */
+    size_t kind_start[STORE_KIND_MAX + 2];  /* name (and where each kind starts). */
+    uint32_t* merge_mark;       /* Scratch of store_merge(): which symbols are */
+    size_t n_merge_mark;        /* listed in the file being merged (those */
+    uint32_t merge_epoch;       /* marked with the current epoch). */
+    int frozen;
+    size_t n_intern_hits;       /* Statistics for store_report(). */
+    size_t intern_saved;
+} STORE;
+
+
+void store_init(STORE* store);
+void store_fini(STORE* store);
+
+/* Get ID of the interned copy of the string, owned by the store. */
+STORE_ID store_intern(STORE* store, const char* str);
+
+/* Compact the complete store and make it read-only (see above). Nothing may
+ * be registered into it (nor merged) anymore; lookups still work. Files get
+ * new IDs. */
+void store_freeze(STORE* store);
+
+static inline int
+store_is_frozen(const STORE* store)
+{
+    return store->frozen;
+}
+
+/* Print some statistics about the store (in verbose mode). */
+void store_report(const STORE* store);
+
+/* Register the entity in the store, or find it if it is already there.
+ * Returns ID of the entity. */
+STORE_ID store_register_file(STORE* store, const char* path);
+STORE_ID store_register_function(STORE* store, STORE_ID file, const char* name, const char* long_name);
+STORE_ID store_register_type(STORE* store, STORE_ID file, const char* name, const char* long_name);
+
+/* Set documentation of the symbol (unless it already has some). */
+void store_register_doc(STORE* store, STORE_ID symbol, const char* raw_doc);
+
+/* Set the line and column where the symbol is declared (in the file it has
+ * been registered with) and what encloses it (unless the symbol already has
+ * it), and add flags to it. */
+void store_register_location(STORE* store, STORE_ID symbol, uint32_t line, uint32_t column);
+void store_register_parent(STORE* store, STORE_ID symbol, STORE_ID parent);
+void store_register_flags(STORE* store, STORE_ID symbol, unsigned flags);
+
+/* Set USR of the symbol and USRs of types it refers to (unless the symbol
+ * already has them). */
+void store_register_usr(STORE* store, STORE_ID symbol, const char* usr);
+void store_register_refs(STORE* store, STORE_ID symbol, const char** usrs, unsigned n_usrs);
+
+/* Resolve all references. To be called once all symbols are registered. If
+ * more symbols share a USR, the one registered first wins. */
+void store_link(STORE* store);
+
+/* Returns STORE_NO_ID if there is no such entity. */
+STORE_ID store_lookup_file(const STORE* store, const char* path);
+STORE_ID store_lookup_symbol(const STORE* store, const char* long_name);
+STORE_ID store_lookup_usr(const STORE* store, const char* usr);
+
+static inline size_t
+store_file_count(const STORE* store)
+{
+    return buffer_size(&store->files) / sizeof(STORE_FILE);
+}
+
+static inline const STORE_FILE*
+store_file(const STORE* store, STORE_ID id)
+{
+    return ((const STORE_FILE*) store->files.data) + id;
+}
+
+/* Returns NULL for STORE_NO_ID. Note the string table may move when more
+ * strings are added, so do not keep the pointer across any registration. */
+static inline const char*
+store_string(const STORE* store, STORE_ID id)
+{
+    return (id != STORE_NO_ID ? (const char*) store->strings.data + id : NULL);
+}
+
+static inline const char*
+store_file_path(const STORE* store, STORE_ID id)
+{
+    return store_string(store, store_file(store, id)->path);
+}
+
+static inline size_t
+store_symbol_count(const STORE* store)
+{
+    return store->symbols.count;
+}
+
+static inline unsigned
+store_symbol_kind(const STORE* store, STORE_ID id)
+{
+    return store->symbols.kind[id];
+}
+
+static inline const char*
+store_symbol_name(const STORE* store, STORE_ID id)
+{
+    return store_string(store, store->symbols.name[id]);
+}
+
+static inline const char*
+store_symbol_long_name(const STORE* store, STORE_ID id)
+{
+    return store_string(store, store->symbols.long_name[id]);
+}
+
+static inline const char*
+store_symbol_doc(const STORE* store, STORE_ID id)
+{
+    return store_string(store, store->symbols.doc[id]);
+}
+
+static inline const char*
+store_symbol_usr(const STORE* store, STORE_ID id)
+{
+    return store_string(store, store->symbols.usr[id]);
+}
+
+static inline STORE_LOC
+store_symbol_loc(const STORE* store, STORE_ID id)
+{
+    return store->symbols.loc[id];
+}
+
+static inline STORE_ID
+store_symbol_file(const STORE* store, STORE_ID id)
+{
+    return STORE_LOC_FILE(store->symbols.loc[id]);
+}
+
+static inline const STORE_REF*
+store_symbol_refs(const STORE* store, STORE_ID id, unsigned* p_n_refs)
+{
+    *p_n_refs = store->symbols.n_refs[id];
+    return ((const STORE_REF*) store->refs.data) + store->symbols.first_ref[id];
+}
+
+/* Add all contents of the (partial) store `part` into the `store`, in time
+ * linear in the size of the `part`. Symbols present in both (i.e. having the
+ * same USR or, if they have none, the same long name) are merged into one,
+ * whose attributes come from the better of the two records: the one with a
+ * documentation, then a definition, then from the file with the smaller
+ * path. So the result does not depend on the order of merging. The `part`
+ * may be left empty (or not); the caller still has to release it with
+ * store_fini(). */
+void store_merge(STORE* store, STORE* part);
+
+/* Queries on a frozen store. Each of them provides a contiguous range of
+ * symbol IDs (valid until store_fini()) and returns its size. The secondary
+ * indexes the queries need are built on the first use and kept, so queries
+ * nobody makes cost nothing, and none of them scans the whole store. (Not
+ * thread-safe for the same reason.)
+ *
+ * store_query_name():   Symbols with the (short) name, e.g. all overloads.
+ * store_query_prefix(): Symbols whose name starts with the prefix; sorted
+ *                       by the name (and then the long name).
+ * store_query_kind():   Symbols of the kind; sorted by the long name.
+ * store_query_file():   Symbols declared in the file; sorted by the kind and
+ *                       the long name.
+ */
+size_t store_query_name(STORE* store, const char* name, const STORE_ID** p_ids);
+size_t store_query_prefix(STORE* store, const char* prefix, const STORE_ID** p_ids);
+size_t store_query_kind(STORE* store, unsigned kind, const STORE_ID** p_ids);
+size_t store_query_file(const STORE* store, STORE_ID file, const STORE_ID** p_ids);
+
+/* Convert the store to the VALUE tree of the shape described above. */
+void store_export(const STORE* store, VALUE* root);
+
+/* Add all entities described by the VALUE tree into the store. Unknown
+ * members of the tree are ignored. The `name` is used only for error
+ * messages. Returns zero on success, or -1 if the tree is malformed. */
+int store_import(STORE* store, const VALUE* root, const char* name);
 
-VALUE* store_register_file(VALUE* store, const char* fname);
-VALUE* store_register_function(VALUE* store, VALUE* file, const char* name, const char* long_name);
+/* Load a store previously saved by the JSON generator and merge it into the
+ * `store`. Returns zero on success, or -1 on failure (the error is reported
+ * to the user). */
+int store_load_json(STORE* store, const char* path);
 
-void store_register_doc(VALUE* item, const char* raw_doc);
+/* Lower-level variant of store_load_json(): Read the JSON file (whose root
+ * has to be an object) into a new VALUE. */
+int store_read_json(const char* path, VALUE* p_root);
 
-void store_init(VALUE* store);
-void store_fini(VALUE* store);
+/* Same as store_read_json() but the JSON is already in memory. The `name`
+ * is used only for error messages. */
+int store_parse_json(const char* data, size_t size, const char* name, VALUE* p_root);
 
 
 #endif  /* DOCBAKER_STORE_H */
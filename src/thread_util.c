@@ -0,0 +1,190 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "thread_util.h"
+
+#ifdef _WIN32
+    #include <process.h>
+#endif
+
+
+typedef struct THREAD_START {
+    THREAD_FUNC func;
+    void* arg;
+} THREAD_START;
+
+
+#ifdef _WIN32
+static unsigned __stdcall
+thread_proc(void* param)
+#else
+static void*
+thread_proc(void* param)
+#endif
+{
+    THREAD_START start = * (THREAD_START*) param;
+
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+
+void
+thread_create(THREAD* thread, THREAD_FUNC func, void* arg)
+{
+    THREAD_START* start;
+
+    start = (THREAD_START*) malloc(sizeof(THREAD_START));
+    CHECK(start != NULL);
+    start->func = func;
+    start->arg = arg;
+
+#ifdef _WIN32
+    *thread = (HANDLE) _beginthreadex(NULL, 0, thread_proc, start, 0, NULL);
+    CHECK(*thread != NULL);
+#else
+    errno = pthread_create(thread, NULL, thread_proc, start);
+    CHECK(errno == 0);
+#endif
+}
+
+void
+thread_join(THREAD* thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+#else
+    pthread_join(*thread, NULL);
+#endif
+}
+
+int
+thread_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+    return (int) si.dwNumberOfProcessors;
+#else
+    long n;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0 ? (int) n : 1);
+#endif
+}
+
+
+void
+mutex_init(MUTEX* mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void
+mutex_fini(MUTEX* mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void
+mutex_lock(MUTEX* mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void
+mutex_unlock(MUTEX* mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+
+void
+condvar_init(CONDVAR* cond)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+void
+condvar_fini(CONDVAR* cond)
+{
+#ifdef _WIN32
+    /* noop */
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+void
+condvar_wait(CONDVAR* cond, MUTEX* mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void
+condvar_signal(CONDVAR* cond)
+{
+#ifdef _WIN32
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+void
+condvar_broadcast(CONDVAR* cond)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
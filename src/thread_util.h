@@ -0,0 +1,72 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_THREAD_UTIL_H
+#define DOCBAKER_THREAD_UTIL_H
+
+#include "misc.h"
+
+#ifndef _WIN32
+    #include <pthread.h>
+#endif
+
+
+/* Thin portable wrappers of threads and synchronization primitives. There
+ * is nothing fancy: just the stuff we need to run more parser workers. */
+
+#ifdef _WIN32
+    typedef HANDLE THREAD;
+    typedef CRITICAL_SECTION MUTEX;
+    typedef CONDITION_VARIABLE CONDVAR;
+#else
+    typedef pthread_t THREAD;
+    typedef pthread_mutex_t MUTEX;
+    typedef pthread_cond_t CONDVAR;
+#endif
+
+
+typedef void (*THREAD_FUNC)(void* /*arg*/);
+
+void thread_create(THREAD* thread, THREAD_FUNC func, void* arg);
+void thread_join(THREAD* thread);
+
+/* Get count of CPU cores available to the process. */
+int thread_cpu_count(void);
+
+
+void mutex_init(MUTEX* mutex);
+void mutex_fini(MUTEX* mutex);
+void mutex_lock(MUTEX* mutex);
+void mutex_unlock(MUTEX* mutex);
+
+
+void condvar_init(CONDVAR* cond);
+void condvar_fini(CONDVAR* cond);
+void condvar_wait(CONDVAR* cond, MUTEX* mutex);
+void condvar_signal(CONDVAR* cond);
+void condvar_broadcast(CONDVAR* cond);
+
+
+#endif  /* DOCBAKER_THREAD_UTIL_H */
@@ -39,6 +39,9 @@
 
 /* Building for Windows platform? */
 #ifdef _WIN32
+    /* (Winsock 2 has to be included before <windows.h> drags in the old
+     * Winsock.) */
+    #include <winsock2.h>
     #include <windows.h>
     #ifndef PATH_MAX
         #define PATH_MAX        MAX_PATH
@@ -53,6 +56,9 @@
     #ifndef S_ISDIR
         #define S_ISDIR(mode)   (((mode) & S_IFDIR) != 0)
     #endif
+    #ifndef S_ISREG
+        #define S_ISREG(mode)   (((mode) & S_IFREG) != 0)
+    #endif
 #endif  /* _WIN32 */
 
 
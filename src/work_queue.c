@@ -0,0 +1,157 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "work_queue.h"
+
+
+static int
+work_queue_item_before(const WORK_QUEUE_ITEM* a, const WORK_QUEUE_ITEM* b)
+{
+    if(a->cost != b->cost)
+        return (a->cost > b->cost);
+    return (a->seq < b->seq);
+}
+
+static void
+work_queue_sift_up(WORK_QUEUE* queue, size_t i)
+{
+    WORK_QUEUE_ITEM tmp = queue->heap[i];
+
+    while(i > 0  &&  work_queue_item_before(&tmp, &queue->heap[(i-1) / 2])) {
+        queue->heap[i] = queue->heap[(i-1) / 2];
+        i = (i-1) / 2;
+    }
+    queue->heap[i] = tmp;
+}
+
+static void
+work_queue_sift_down(WORK_QUEUE* queue, size_t i)
+{
+    WORK_QUEUE_ITEM tmp = queue->heap[i];
+    size_t child;
+
+    while(1) {
+        child = 2*i + 1;
+        if(child >= queue->count)
+            break;
+        if(child+1 < queue->count  &&  work_queue_item_before(&queue->heap[child+1], &queue->heap[child]))
+            child++;
+        if(!work_queue_item_before(&queue->heap[child], &tmp))
+            break;
+        queue->heap[i] = queue->heap[child];
+        i = child;
+    }
+    queue->heap[i] = tmp;
+}
+
+void
+work_queue_init(WORK_QUEUE* queue, size_t capacity)
+{
+    queue->heap = (WORK_QUEUE_ITEM*) malloc(capacity * sizeof(WORK_QUEUE_ITEM));
+    CHECK(queue->heap != NULL);
+    queue->capacity = capacity;
+    queue->count = 0;
+    queue->seq = 0;
+    queue->is_closed = 0;
+
+    mutex_init(&queue->mutex);
+    condvar_init(&queue->not_empty);
+    condvar_init(&queue->not_full);
+
+    queue->max_count = 0;
+    queue->n_push_waits = 0;
+    queue->n_pop_waits = 0;
+}
+
+void
+work_queue_fini(WORK_QUEUE* queue)
+{
+    condvar_fini(&queue->not_full);
+    condvar_fini(&queue->not_empty);
+    mutex_fini(&queue->mutex);
+    free(queue->heap);
+}
+
+size_t
+work_queue_push(WORK_QUEUE* queue, void* item, uint64_t cost)
+{
+    size_t depth;
+
+    mutex_lock(&queue->mutex);
+
+    if(queue->count >= queue->capacity) {
+        queue->n_push_waits++;
+        while(queue->count >= queue->capacity)
+            condvar_wait(&queue->not_full, &queue->mutex);
+    }
+
+    queue->heap[queue->count].item = item;
+    queue->heap[queue->count].cost = cost;
+    queue->heap[queue->count].seq = queue->seq++;
+    work_queue_sift_up(queue, queue->count);
+    depth = ++queue->count;
+    if(depth > queue->max_count)
+        queue->max_count = depth;
+
+    condvar_signal(&queue->not_empty);
+    mutex_unlock(&queue->mutex);
+    return depth;
+}
+
+void*
+work_queue_pop(WORK_QUEUE* queue)
+{
+    void* item = NULL;
+
+    mutex_lock(&queue->mutex);
+
+    if(queue->count == 0  &&  !queue->is_closed) {
+        queue->n_pop_waits++;
+        while(queue->count == 0  &&  !queue->is_closed)
+            condvar_wait(&queue->not_empty, &queue->mutex);
+    }
+
+    if(queue->count > 0) {
+        item = queue->heap[0].item;
+        queue->count--;
+        if(queue->count > 0) {
+            queue->heap[0] = queue->heap[queue->count];
+            work_queue_sift_down(queue, 0);
+        }
+        condvar_signal(&queue->not_full);
+    }
+
+    mutex_unlock(&queue->mutex);
+    return item;
+}
+
+void
+work_queue_close(WORK_QUEUE* queue)
+{
+    mutex_lock(&queue->mutex);
+    queue->is_closed = 1;
+    condvar_broadcast(&queue->not_empty);
+    mutex_unlock(&queue->mutex);
+}
@@ -0,0 +1,83 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DOCBAKER_WORK_QUEUE_H
+#define DOCBAKER_WORK_QUEUE_H
+
+#include "misc.h"
+#include "thread_util.h"
+
+
+/* Bounded blocking queue connecting a producer (the directory walker) with
+ * consumers (parser workers). When the queue is full, the producer is
+ * blocked until some consumer catches up, so the memory needed for pending
+ * work stays constant no matter how many files we process.
+ *
+ * Each item comes with its (predicted) cost and consumers always get the
+ * most expensive pending item first. Scheduling the longest jobs first
+ * prevents a few huge items picked up at the very end from prolonging the
+ * total time while all the other workers have nothing to do. Items of the
+ * same cost are consumed in the FIFO order.
+ */
+typedef struct WORK_QUEUE_ITEM {
+    void* item;
+    uint64_t cost;
+    uint64_t seq;
+} WORK_QUEUE_ITEM;
+
+typedef struct WORK_QUEUE {
+    WORK_QUEUE_ITEM* heap;  /* Binary max-heap. */
+    size_t capacity;
+    size_t count;
+    uint64_t seq;
+    int is_closed;
+
+    MUTEX mutex;
+    CONDVAR not_empty;
+    CONDVAR not_full;
+
+    /* Statistics. */
+    size_t max_count;       /* Maximal depth reached. */
+    unsigned n_push_waits;  /* How many times the producer had to wait. */
+    unsigned n_pop_waits;   /* How many times a consumer had to wait. */
+} WORK_QUEUE;
+
+
+void work_queue_init(WORK_QUEUE* queue, size_t capacity);
+void work_queue_fini(WORK_QUEUE* queue);
+
+/* Add an item. Blocks while the queue is full. Returns the queue depth
+ * (including the new item). */
+size_t work_queue_push(WORK_QUEUE* queue, void* item, uint64_t cost);
+
+/* Take the most expensive item. Blocks while the queue is empty. When the
+ * queue is closed and all items have been consumed, NULL is returned. */
+void* work_queue_pop(WORK_QUEUE* queue);
+
+/* Tell consumers there is nothing more to come. */
+void work_queue_close(WORK_QUEUE* queue);
+
+
+#endif  /* DOCBAKER_WORK_QUEUE_H */
@@ -0,0 +1,451 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Test of the HTTP cache backend against a stand-in server running in a
+ * thread of the test itself. The server keeps the entries in memory and
+ * understands GET, HEAD and PUT. What else it does depends on the first
+ * component of the URL path:
+ *
+ *   /cache/...     Keeps the connection alive (so HEADs can be pipelined).
+ *   /close/...     Closes the connection after each response.
+ *   /broken/...    Responds to everything with 500.
+ */
+
+#include "misc.h"
+#include "buffer.h"
+#include "cache_backend.h"
+#include "thread_util.h"
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    typedef SOCKET TEST_SOCKET;
+    #define test_close_socket(s)        closesocket(s)
+#else
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+    typedef int TEST_SOCKET;
+    #define test_close_socket(s)        close(s)
+#endif
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL                0
+#endif
+
+
+int verbose_level = 0;
+
+static int n_failures = 0;
+
+#define TEST_CHECK(cond)                                                    \
+    do {                                                                    \
+        if(!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+            n_failures++;                                                   \
+        }                                                                   \
+    } while(0)
+
+
+/**********************
+ *** Stand-in server ***
+ **********************/
+
+#define SERVER_MAX_ENTRIES          256
+
+typedef struct SERVER_ENTRY {
+    char path[128];
+    BUFFER data;
+} SERVER_ENTRY;
+
+typedef struct SERVER {
+    TEST_SOCKET listen_sock;
+    unsigned short port;
+    SERVER_ENTRY entries[SERVER_MAX_ENTRIES];
+    int n_entries;
+    MUTEX mutex;
+    int n_connections;
+} SERVER;
+
+typedef struct SERVER_CONN {
+    TEST_SOCKET sock;
+    size_t pos;
+    size_t len;
+    char buffer[4096];
+} SERVER_CONN;
+
+static int
+server_read_line(SERVER_CONN* conn, char* line, size_t line_size)
+{
+    size_t len = 0;
+    int n;
+
+    while(1) {
+        if(conn->pos >= conn->len) {
+            n = recv(conn->sock, conn->buffer, sizeof(conn->buffer), 0);
+            if(n <= 0)
+                return -1;
+            conn->pos = 0;
+            conn->len = (size_t) n;
+        }
+        if(conn->buffer[conn->pos] == '\n') {
+            conn->pos++;
+            break;
+        }
+        if(len + 1 < line_size)
+            line[len++] = conn->buffer[conn->pos];
+        conn->pos++;
+    }
+
+    if(len > 0  &&  line[len-1] == '\r')
+        len--;
+    line[len] = '\0';
+    return 0;
+}
+
+static int
+server_read_body(SERVER_CONN* conn, size_t size, BUFFER* data)
+{
+    size_t n;
+    int ret;
+
+    while(size > 0) {
+        if(conn->pos >= conn->len) {
+            ret = recv(conn->sock, conn->buffer, sizeof(conn->buffer), 0);
+            if(ret <= 0)
+                return -1;
+            conn->pos = 0;
+            conn->len = (size_t) ret;
+        }
+        n = conn->len - conn->pos;
+        if(n > size)
+            n = size;
+        if(buffer_append(data, conn->buffer + conn->pos, n) != 0)
+            return -1;
+        conn->pos += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+static SERVER_ENTRY*
+server_find(SERVER* server, const char* path)
+{
+    int i;
+
+    for(i = 0; i < server->n_entries; i++) {
+        if(strcmp(server->entries[i].path, path) == 0)
+            return &server->entries[i];
+    }
+    return NULL;
+}
+
+static void
+server_respond(SERVER_CONN* conn, int status, const void* body, size_t size, int with_body)
+{
+    char head[256];
+
+    snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: %lu\r\n\r\n",
+             status, (status == 200 ? "OK" : (status == 404 ? "Not Found" : "Error")),
+             (unsigned long) size);
+    /* (The client may have hung up already if it did not like a previous
+     * response.) */
+    send(conn->sock, head, (int) strlen(head), MSG_NOSIGNAL);
+    if(with_body  &&  size > 0)
+        send(conn->sock, (const char*) body, (int) size, MSG_NOSIGNAL);
+}
+
+/* Serve requests on the connection. Returns non-zero if the server should
+ * quit. */
+static int
+server_serve(SERVER* server, SERVER_CONN* conn)
+{
+    char line[512];
+    char method[16];
+    char path[128];
+    char protocol[16];
+    unsigned long content_length;
+    int keep_alive;
+    SERVER_ENTRY* entry;
+    BUFFER body;
+
+    while(server_read_line(conn, line, sizeof(line)) == 0) {
+        if(strcmp(line, "QUIT") == 0)
+            return 1;
+        if(sscanf(line, "%15s %127s %15s", method, path, protocol) != 3)
+            return 0;
+
+        content_length = 0;
+        keep_alive = (strcmp(protocol, "HTTP/1.1") == 0);
+        while(server_read_line(conn, line, sizeof(line)) == 0  &&  line[0] != '\0') {
+            if(strncmp(line, "Content-Length:", 15) == 0)
+                content_length = strtoul(line + 15, NULL, 10);
+            else if(strcmp(line, "Connection: close") == 0)
+                keep_alive = 0;
+        }
+
+        buffer_init(&body);
+        if(server_read_body(conn, content_length, &body) != 0) {
+            buffer_fini(&body);
+            return 0;
+        }
+
+        if(strncmp(path, "/broken/", 8) == 0) {
+            server_respond(conn, 500, NULL, 0, 0);
+        } else if(strcmp(method, "PUT") == 0) {
+            entry = server_find(server, path);
+            if(entry == NULL  &&  server->n_entries < SERVER_MAX_ENTRIES) {
+                entry = &server->entries[server->n_entries++];
+                snprintf(entry->path, sizeof(entry->path), "%s", path);
+                buffer_init(&entry->data);
+            }
+            if(entry != NULL) {
+                buffer_clear(&entry->data);
+                buffer_append(&entry->data, body.data, body.size);
+            }
+            server_respond(conn, (entry != NULL ? 201 : 500), NULL, 0, 0);
+        } else if(strcmp(method, "GET") == 0  ||  strcmp(method, "HEAD") == 0) {
+            entry = server_find(server, path);
+            if(entry != NULL)
+                server_respond(conn, 200, entry->data.data, entry->data.size, (method[0] == 'G'));
+            else
+                server_respond(conn, 404, NULL, 0, 0);
+        } else {
+            server_respond(conn, 500, NULL, 0, 0);
+        }
+        buffer_fini(&body);
+
+        if(!keep_alive  ||  strncmp(path, "/close/", 7) == 0)
+            break;
+    }
+
+    return 0;
+}
+
+static void
+server_thread(void* arg)
+{
+    SERVER* server = (SERVER*) arg;
+    SERVER_CONN conn;
+    int quit = 0;
+
+    while(!quit) {
+        conn.sock = accept(server->listen_sock, NULL, NULL);
+        if(conn.sock < 0)
+            break;
+        conn.pos = 0;
+        conn.len = 0;
+        mutex_lock(&server->mutex);
+        server->n_connections++;
+        mutex_unlock(&server->mutex);
+        quit = server_serve(server, &conn);
+        test_close_socket(conn.sock);
+    }
+}
+
+static void
+server_start(SERVER* server, THREAD* thread)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(server, 0, sizeof(SERVER));
+    mutex_init(&server->mutex);
+    server->listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    CHECK(bind(server->listen_sock, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    CHECK(listen(server->listen_sock, 16) == 0);
+    CHECK(getsockname(server->listen_sock, (struct sockaddr*) &addr, &addr_len) == 0);
+    server->port = ntohs(addr.sin_port);
+
+    thread_create(thread, server_thread, server);
+}
+
+static void
+server_stop(SERVER* server, THREAD* thread)
+{
+    struct sockaddr_in addr;
+    TEST_SOCKET sock;
+    int i;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(server->port);
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(connect(sock, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    send(sock, "QUIT\r\n", 6, MSG_NOSIGNAL);
+    thread_join(thread);
+    test_close_socket(sock);
+    test_close_socket(server->listen_sock);
+
+    for(i = 0; i < server->n_entries; i++)
+        buffer_fini(&server->entries[i].data);
+    mutex_fini(&server->mutex);
+}
+
+static int
+server_connections(SERVER* server)
+{
+    int n;
+
+    mutex_lock(&server->mutex);
+    n = server->n_connections;
+    mutex_unlock(&server->mutex);
+    return n;
+}
+
+
+/*************
+ *** Tests ***
+ *************/
+
+#define TEST_N_KEYS         100     /* More than one batch of HEADs. */
+
+static uint64_t
+test_key(int i)
+{
+    return 0x0123456789abcdefULL * (uint64_t) (i + 1);
+}
+
+static CACHE_BACKEND*
+test_backend(const SERVER* server, const char* prefix)
+{
+    char url[128];
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/%s", (unsigned) server->port, prefix);
+    return cache_http_backend_create(url);
+}
+
+static void
+test_get_put(CACHE_BACKEND* backend)
+{
+    static const char data[] = "{ \"files\": {} }";
+    BUFFER buf;
+
+    buffer_init(&buf);
+    TEST_CHECK(backend->get(backend, test_key(0), &buf) == CACHE_BACKEND_NOT_FOUND);
+    TEST_CHECK(buf.size == 0);
+
+    TEST_CHECK(backend->put(backend, test_key(0), data, strlen(data)) == 0);
+    TEST_CHECK(backend->get(backend, test_key(0), &buf) == CACHE_BACKEND_FOUND);
+    TEST_CHECK(buf.size == strlen(data)  &&  memcmp(buf.data, data, buf.size) == 0);
+
+    /* Another key is still a miss. */
+    buffer_clear(&buf);
+    TEST_CHECK(backend->get(backend, test_key(1), &buf) == CACHE_BACKEND_NOT_FOUND);
+    buffer_fini(&buf);
+}
+
+/* Check existence of n_keys keys (a third of them stored) and how many
+ * connections that takes. */
+static void
+test_exists(SERVER* server, CACHE_BACKEND* backend, int n_keys, int n_connections)
+{
+    uint64_t keys[TEST_N_KEYS];
+    int exists[TEST_N_KEYS];
+    int n;
+    int i;
+
+    for(i = 0; i < n_keys; i++) {
+        keys[i] = test_key(i);
+        exists[i] = -1;
+        if(i % 3 == 0)
+            TEST_CHECK(backend->put(backend, keys[i], "{}", 2) == 0);
+    }
+
+    n = server_connections(server);
+    TEST_CHECK(backend->exists(backend, keys, n_keys, exists) == 0);
+    TEST_CHECK(server_connections(server) - n == n_connections);
+    for(i = 0; i < n_keys; i++)
+        TEST_CHECK(exists[i] == (i % 3 == 0));
+}
+
+static void
+test_server_error(CACHE_BACKEND* backend)
+{
+    uint64_t keys[3] = { test_key(0), test_key(1), test_key(2) };
+    int exists[3];
+    BUFFER buf;
+
+    buffer_init(&buf);
+    TEST_CHECK(backend->get(backend, test_key(0), &buf) == CACHE_BACKEND_ERROR);
+    TEST_CHECK(backend->put(backend, test_key(0), "{}", 2) != 0);
+    TEST_CHECK(backend->exists(backend, keys, 3, exists) != 0);
+    buffer_fini(&buf);
+}
+
+int
+main(int argc, char** argv)
+{
+    CACHE_BACKEND* backend;
+    CACHE_BACKEND* close_backend;
+    CACHE_BACKEND* broken_backend;
+    SERVER server;
+    THREAD thread;
+    BUFFER buf;
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    CHECK(WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0);
+#endif
+
+    server_start(&server, &thread);
+    backend = test_backend(&server, "cache");
+    close_backend = test_backend(&server, "close");
+    broken_backend = test_backend(&server, "broken/");
+
+    test_get_put(backend);
+
+    /* HEADs are pipelined, so the two batches of 64 keys at most take one
+     * connection each. */
+    test_exists(&server, backend, TEST_N_KEYS, 2);
+
+    /* A server closing each connection still gets asked about all keys. */
+    test_exists(&server, close_backend, 10, 10);
+
+    test_server_error(broken_backend);
+
+    server_stop(&server, &thread);
+
+    /* Nobody listens anymore. */
+    buffer_init(&buf);
+    TEST_CHECK(backend->get(backend, test_key(0), &buf) == CACHE_BACKEND_ERROR);
+    buffer_fini(&buf);
+
+    backend->destroy(backend);
+    close_backend->destroy(close_backend);
+    broken_backend->destroy(broken_backend);
+
+    if(n_failures > 0) {
+        fprintf(stderr, "%d check(s) failed.\n", n_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+# Check that merging partial stores of all shards gives the same store as
+# processing all the input at once, no matter the order of the shards.
+#
+# Expects DOCBAKER (the executable), SRC_DIR (the input files) and WORK_DIR.
+
+set(INPUTS a.h b.h c.h)
+
+function(docbaker)
+    execute_process(COMMAND ${DOCBAKER} ${ARGN}
+            WORKING_DIRECTORY ${SRC_DIR}
+            RESULT_VARIABLE result
+            OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "docbaker ${ARGN} failed (${result}).")
+    endif()
+endfunction()
+
+function(expect_same_file expected actual)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${expected} ${actual}
+            RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${actual} differs from ${expected}.")
+    endif()
+endfunction()
+
+# Every record of the symbol `long_name` in the JSON store `path` has to
+# match all the given regular expressions.
+function(expect_symbol path long_name)
+    file(READ ${path} json)
+    string(REGEX MATCHALL "\"${long_name}\": {[^}]*}" records "${json}")
+    if(NOT records)
+        message(FATAL_ERROR "${path} has no ${long_name}.")
+    endif()
+    foreach(record ${records})
+        foreach(regex ${ARGN})
+            if(NOT record MATCHES "${regex}")
+                message(FATAL_ERROR "${long_name} in ${path} does not match '${regex}':\n${record}")
+            endif()
+        endforeach()
+    endforeach()
+endfunction()
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+docbaker(--json=${WORK_DIR}/all.json ${INPUTS})
+# scale() is declared in a.h (line 3) but defined in b.h (line 5): the
+# definition has to win in both files.
+expect_symbol(${WORK_DIR}/all.json "scale\\(int\\)" "\"definition\": true" "\"line\": 5,")
+
+docbaker(--shard=1/2 --json=${WORK_DIR}/shard1.json ${INPUTS})
+docbaker(--shard=2/2 --json=${WORK_DIR}/shard2.json ${INPUTS})
+
+docbaker(merge --json=${WORK_DIR}/merged12.json ${WORK_DIR}/shard1.json ${WORK_DIR}/shard2.json)
+expect_same_file(${WORK_DIR}/all.json ${WORK_DIR}/merged12.json)
+
+docbaker(merge --json=${WORK_DIR}/merged21.json ${WORK_DIR}/shard2.json ${WORK_DIR}/shard1.json)
+expect_same_file(${WORK_DIR}/all.json ${WORK_DIR}/merged21.json)
+
+# a.h only declares scale() and b.h defines it. Merging their stores has to
+# pick the definition whichever side comes first.
+docbaker(--json=${WORK_DIR}/a.json a.h)
+docbaker(--json=${WORK_DIR}/b.json b.h)
+docbaker(--json=${WORK_DIR}/ab.json a.h b.h)
+expect_symbol(${WORK_DIR}/a.json "scale\\(int\\)" "\"line\": 3,")
+
+docbaker(merge --json=${WORK_DIR}/merged_ab.json ${WORK_DIR}/a.json ${WORK_DIR}/b.json)
+expect_symbol(${WORK_DIR}/merged_ab.json "scale\\(int\\)" "\"definition\": true" "\"line\": 5,")
+expect_same_file(${WORK_DIR}/ab.json ${WORK_DIR}/merged_ab.json)
+
+docbaker(merge --json=${WORK_DIR}/merged_ba.json ${WORK_DIR}/b.json ${WORK_DIR}/a.json)
+expect_same_file(${WORK_DIR}/ab.json ${WORK_DIR}/merged_ba.json)
@@ -0,0 +1,5 @@
+struct point;
+
+int scale(int x);
+
+int offset(int x);
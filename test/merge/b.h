@@ -0,0 +1,5 @@
+/* Second declaration of offset() comes first in the file. */
+int offset(int x);
+
+
+int scale(int x) { return 2 * x; }
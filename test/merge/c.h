@@ -0,0 +1,6 @@
+struct point {
+    int x;
+    int y;
+};
+
+int offset(int x);
@@ -0,0 +1,40 @@
+# Check that the HTML generator leaves up-to-date pages alone and deletes
+# pages of files which are no longer processed.
+#
+# Expects DOCBAKER (the executable), SRC_DIR (the input files) and WORK_DIR.
+
+function(docbaker expected_summary)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E env LC_ALL=C LANGUAGE=
+                ${DOCBAKER} --html=${WORK_DIR}/html ${ARGN}
+            WORKING_DIRECTORY ${SRC_DIR}
+            RESULT_VARIABLE result
+            OUTPUT_VARIABLE output)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "docbaker ${ARGN} failed (${result}).")
+    endif()
+    if(NOT output MATCHES "Output: ${expected_summary}\\.")
+        message(FATAL_ERROR "docbaker ${ARGN}: expected '${expected_summary}', got:\n${output}")
+    endif()
+endfunction()
+
+function(expect_page_count expected)
+    file(GLOB pages ${WORK_DIR}/html/*.html)
+    list(LENGTH pages n)
+    if(NOT n EQUAL expected)
+        message(FATAL_ERROR "Expected ${expected} pages, found ${n}: ${pages}")
+    endif()
+endfunction()
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+docbaker("4 files written, 0 unchanged, 0 up to date, 0 stale deleted" a.h b.h c.h)
+expect_page_count(4)
+
+# Nothing has changed so nothing gets even regenerated.
+docbaker("0 files written, 0 unchanged, 4 up to date, 0 stale deleted" a.h b.h c.h)
+expect_page_count(4)
+
+# The page of c.h is stale now. (The index changes as it lists the files.)
+docbaker("1 files written, 0 unchanged, 2 up to date, 1 stale deleted" a.h b.h)
+expect_page_count(3)
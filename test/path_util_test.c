@@ -0,0 +1,215 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Test of the lexical path normalization and of the (cached) resolution of
+ * canonical paths. */
+
+#include "misc.h"
+#include "path_util.h"
+
+
+int verbose_level = 0;
+
+static int n_failures = 0;
+
+#define TEST_CHECK(cond)                                                    \
+    do {                                                                    \
+        if(!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+            n_failures++;                                                   \
+        }                                                                   \
+    } while(0)
+
+
+static const struct {
+    const char* path;
+    const char* normalized;
+} test_normalize_cases[] = {
+    { "foo/bar.h",              "foo/bar.h" },
+    { "./foo//bar/../baz.h",    "foo/baz.h" },
+    { "foo/./bar/.",            "foo/bar" },
+    { "foo///bar//",            "foo/bar" },
+    { "a/b/c/../../d",          "a/d" },
+    { "foo/..",                 "." },
+    { ".",                      "." },
+    { "",                       "." },
+    { "../foo",                 "../foo" },
+    { "foo/../../bar",          "../bar" },
+    { "../../foo/..",           "../.." },
+    { "/",                      "/" },
+    { "//foo///bar",            "/foo/bar" },
+    { "/foo/..",                "/" },
+    { "/../foo",                "/foo" },
+    { "/./foo/./../bar",        "/bar" },
+#ifdef _WIN32
+    { "C:\\foo\\.\\bar\\..\\baz.h", "C:/foo/baz.h" },
+    { "C:/..\\foo",             "C:/foo" },
+#endif
+};
+
+static void
+test_normalize(void)
+{
+    char buffer[PATH_MAX];
+    char long_path[PATH_MAX + 16];
+    size_t i;
+
+    for(i = 0; i < sizeof(test_normalize_cases) / sizeof(test_normalize_cases[0]); i++) {
+        TEST_CHECK(path_normalize(test_normalize_cases[i].path, buffer) == 0);
+        if(strcmp(buffer, test_normalize_cases[i].normalized) != 0) {
+            fprintf(stderr, "path_normalize(\"%s\"): expected \"%s\", got \"%s\"\n",
+                    test_normalize_cases[i].path, test_normalize_cases[i].normalized, buffer);
+            n_failures++;
+        }
+    }
+
+    memset(long_path, 'a', sizeof(long_path) - 1);
+    long_path[sizeof(long_path) - 1] = '\0';
+    TEST_CHECK(path_normalize(long_path, buffer) == -1);
+
+    /* But components which get removed do not count. */
+    long_path[0] = '.';
+    long_path[1] = '/';
+    long_path[PATH_MAX - 4] = '/';
+    long_path[PATH_MAX - 3] = '.';
+    long_path[PATH_MAX - 2] = '.';
+    long_path[PATH_MAX - 1] = '/';
+    TEST_CHECK(path_normalize(long_path, buffer) == 0);
+    TEST_CHECK(strcmp(buffer, long_path + PATH_MAX) == 0);
+}
+
+
+#ifndef _WIN32
+static char test_dir[PATH_MAX];
+
+static void
+test_make_path(char buffer[PATH_MAX], const char* rel_path)
+{
+    CHECK(snprintf(buffer, PATH_MAX, "%s/%s", test_dir, rel_path) < PATH_MAX);
+}
+
+static void
+test_expect_canonical(const char* rel_path, const char* rel_expected)
+{
+    char path[PATH_MAX];
+    char expected[PATH_MAX];
+    char buffer[PATH_MAX];
+
+    test_make_path(path, rel_path);
+    test_make_path(expected, rel_expected);
+    TEST_CHECK(path_canonical(path, buffer) == 0);
+    if(strcmp(buffer, expected) != 0) {
+        fprintf(stderr, "path_canonical(\"%s\"): expected \"%s\", got \"%s\"\n",
+                path, expected, buffer);
+        n_failures++;
+    }
+}
+
+static void
+test_canonical(void)
+{
+    char tmpl[] = "/tmp/path_util_test.XXXXXX";
+    char path[PATH_MAX];
+    char target[PATH_MAX];
+    char buffer[PATH_MAX];
+    FILE* f;
+
+    /* The temporary directory itself may live behind a symlink. */
+    CHECK(mkdtemp(tmpl) != NULL);
+    CHECK(realpath(tmpl, test_dir) != NULL);
+
+    test_make_path(path, "dir");
+    CHECK(mkdir(path, 0755) == 0);
+    test_make_path(path, "dir/sub");
+    CHECK(mkdir(path, 0755) == 0);
+    test_make_path(path, "dir/sub/f.h");
+    f = fopen(path, "w");
+    CHECK(f != NULL);
+    fclose(f);
+    test_make_path(path, "link");
+    CHECK(symlink("dir/sub", path) == 0);
+    test_make_path(path, "dir/sub/flink.h");
+    CHECK(symlink("../../dir/sub/f.h", path) == 0);
+
+    test_expect_canonical("dir/sub/f.h", "dir/sub/f.h");
+    test_expect_canonical("dir//sub/./f.h", "dir/sub/f.h");
+    test_expect_canonical("dir/sub/../sub/f.h", "dir/sub/f.h");
+    test_expect_canonical("link/f.h", "dir/sub/f.h");
+    test_expect_canonical("link/../sub/f.h", "dir/sub/f.h");
+    test_expect_canonical("dir/sub/flink.h", "dir/sub/f.h");
+    test_expect_canonical("dir/sub/..", "dir");
+    test_expect_canonical("dir/.", "dir");
+
+    /* Now the directories come from the cache. */
+    test_expect_canonical("link/f.h", "dir/sub/f.h");
+    test_expect_canonical("dir/sub/../sub/f.h", "dir/sub/f.h");
+
+    /* Relative paths are resolved against the current directory. */
+    CHECK(getcwd(target, PATH_MAX) != NULL);
+    test_make_path(path, "dir");
+    CHECK(chdir(path) == 0);
+    TEST_CHECK(path_canonical("sub/f.h", buffer) == 0);
+    test_make_path(path, "dir/sub/f.h");
+    TEST_CHECK(strcmp(buffer, path) == 0);
+    CHECK(chdir(target) == 0);
+
+    test_make_path(path, "dir/missing.h");
+    TEST_CHECK(path_canonical(path, buffer) == -1);
+    test_make_path(path, "missing/f.h");
+    TEST_CHECK(path_canonical(path, buffer) == -1);
+
+    test_make_path(path, "dir/sub/flink.h");
+    remove(path);
+    test_make_path(path, "dir/sub/f.h");
+    remove(path);
+    test_make_path(path, "link");
+    remove(path);
+    test_make_path(path, "dir/sub");
+    rmdir(path);
+    test_make_path(path, "dir");
+    rmdir(path);
+    rmdir(test_dir);
+}
+#endif
+
+
+int
+main(int argc, char** argv)
+{
+    path_init(argv[0]);
+
+    test_normalize();
+#ifndef _WIN32
+    test_canonical();
+#endif
+
+    path_fini();
+
+    if(n_failures > 0) {
+        fprintf(stderr, "%d check(s) failed.\n", n_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,381 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Test of the frozen store: lookups have to give the same answers as they
+ * have given before store_freeze(), and the queries have to give what a
+ * plain scan of the whole store gives. */
+
+#include "misc.h"
+#include "store.h"
+
+
+int verbose_level = 0;
+
+static int n_failures = 0;
+
+#define TEST_CHECK(cond)                                                    \
+    do {                                                                    \
+        if(!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+            n_failures++;                                                   \
+        }                                                                   \
+    } while(0)
+
+
+/* Files are registered out of the order of their paths, so freezing
+ * renumbers them. */
+static const char* test_files[] = { "z.h", "a.h", "m/b.h", "m/a.h" };
+
+static const struct {
+    int file;               /* Index into test_files[] */
+    unsigned kind;
+    const char* name;
+    const char* long_name;
+    const char* usr;
+    const char* doc;
+    uint32_t line;
+    int is_definition;
+    const char* parent;     /* Long name */
+    const char* ref;        /* USR */
+} test_symbols[] = {
+    { 0, STORE_KIND_FUNCTION, "foo",    "foo(int)",         "c:@F@foo#I",   "Foo of int.",  3, 0, NULL, "c:@S@point" },
+    { 0, STORE_KIND_FUNCTION, "foo",    "foo(char)",        "c:@F@foo#C",   NULL,           4, 1, NULL, NULL },
+    { 1, STORE_KIND_FUNCTION, "foo",    "ns::foo(int)",     "c:@N@ns@F@foo#I", "Foo of int.", 7, 0, NULL, "c:@T@point_t" },
+    { 1, STORE_KIND_FUNCTION, "food",   "food(void)",       "c:@F@food",    NULL,           9, 0, NULL, NULL },
+    { 1, STORE_KIND_TYPE,     "point",  "struct point",     "c:@S@point",   "A point.",     1, 1, NULL, NULL },
+    { 2, STORE_KIND_TYPE,     "point_t", "typedef point_t", "c:@T@point_t", NULL,           2, 1, NULL, "c:@S@point" },
+    { 2, STORE_KIND_FUNCTION, "bar",    "bar(struct point *)", "c:@F@bar",  NULL,           5, 0, NULL, "c:@S@point" },
+    { 3, STORE_KIND_TYPE,     "inner",  "struct outer::inner", "c:@S@outer@S@inner", NULL,  3, 1, "struct point", NULL },
+    { 3, STORE_KIND_FUNCTION, "abc",    "abc(void)",        NULL,           NULL,           8, 0, NULL, NULL },
+};
+
+#define TEST_N_FILES        (sizeof(test_files) / sizeof(test_files[0]))
+#define TEST_N_SYMBOLS      (sizeof(test_symbols) / sizeof(test_symbols[0]))
+
+
+/* What the lookups say about a symbol, in terms which survive freezing
+ * (file IDs change). */
+typedef struct TEST_RECORD {
+    STORE_ID id;
+    char desc[512];
+} TEST_RECORD;
+
+static void
+test_describe(const STORE* store, STORE_ID id, char* buffer, size_t size)
+{
+    const STORE_REF* refs;
+    unsigned n_refs;
+    STORE_LOC loc = store_symbol_loc(store, id);
+    STORE_ID parent = store->symbols.parent[id];
+    const char* usr = store_symbol_usr(store, id);
+    const char* doc = store_symbol_doc(store, id);
+
+    refs = store_symbol_refs(store, id, &n_refs);
+    snprintf(buffer, size, "%u|%s|%s|%s|%s|%s:%u:%u|%x|%s|%u|%s",
+            store_symbol_kind(store, id), store_symbol_name(store, id),
+            store_symbol_long_name(store, id),
+            (usr != NULL ? usr : "-"), (doc != NULL ? doc : "-"),
+            store_file_path(store, STORE_LOC_FILE(loc)),
+            STORE_LOC_LINE(loc), STORE_LOC_COLUMN(loc),
+            store->symbols.flags[id],
+            (parent != STORE_NO_ID ? store_symbol_long_name(store, parent) : "-"),
+            n_refs,
+            (n_refs > 0  &&  refs[0].id != STORE_NO_ID ? store_symbol_long_name(store, refs[0].id) : "-"));
+}
+
+static void
+test_lookup_all(const STORE* store, TEST_RECORD* records, TEST_RECORD* usr_records,
+                STORE_ID* files, size_t* n_file_symbols)
+{
+    size_t i;
+
+    for(i = 0; i < TEST_N_SYMBOLS; i++) {
+        records[i].id = store_lookup_symbol(store, test_symbols[i].long_name);
+        TEST_CHECK(records[i].id != STORE_NO_ID);
+        if(records[i].id != STORE_NO_ID)
+            test_describe(store, records[i].id, records[i].desc, sizeof(records[i].desc));
+
+        usr_records[i].id = STORE_NO_ID;
+        usr_records[i].desc[0] = '\0';
+        if(test_symbols[i].usr != NULL) {
+            usr_records[i].id = store_lookup_usr(store, test_symbols[i].usr);
+            TEST_CHECK(usr_records[i].id == records[i].id);
+            if(usr_records[i].id != STORE_NO_ID)
+                test_describe(store, usr_records[i].id, usr_records[i].desc, sizeof(usr_records[i].desc));
+        }
+    }
+
+    for(i = 0; i < TEST_N_FILES; i++) {
+        files[i] = store_lookup_file(store, test_files[i]);
+        TEST_CHECK(files[i] != STORE_NO_ID);
+        if(files[i] != STORE_NO_ID) {
+            TEST_CHECK(strcmp(store_file_path(store, files[i]), test_files[i]) == 0);
+            n_file_symbols[i] = store_file(store, files[i])->n_symbols;
+        }
+    }
+
+    /* Things which are not there. */
+    TEST_CHECK(store_lookup_symbol(store, "foo(long)") == STORE_NO_ID);
+    TEST_CHECK(store_lookup_symbol(store, "") == STORE_NO_ID);
+    TEST_CHECK(store_lookup_symbol(store, "zzz") == STORE_NO_ID);
+    TEST_CHECK(store_lookup_usr(store, "c:@F@nope") == STORE_NO_ID);
+    /* A doc is interned but it is no USR. */
+    TEST_CHECK(store_lookup_usr(store, "A point.") == STORE_NO_ID);
+    TEST_CHECK(store_lookup_file(store, "b.h") == STORE_NO_ID);
+    TEST_CHECK(store_lookup_file(store, "m") == STORE_NO_ID);
+}
+
+static void
+test_fill(STORE* store)
+{
+    STORE_ID files[TEST_N_FILES];
+    STORE_ID id;
+    const char* ref;
+    size_t i;
+
+    for(i = 0; i < TEST_N_FILES; i++)
+        files[i] = store_register_file(store, test_files[i]);
+
+    for(i = 0; i < TEST_N_SYMBOLS; i++) {
+        if(test_symbols[i].kind == STORE_KIND_FUNCTION)
+            id = store_register_function(store, files[test_symbols[i].file], test_symbols[i].name, test_symbols[i].long_name);
+        else
+            id = store_register_type(store, files[test_symbols[i].file], test_symbols[i].name, test_symbols[i].long_name);
+        store_register_location(store, id, test_symbols[i].line, 5);
+        if(test_symbols[i].is_definition)
+            store_register_flags(store, id, STORE_FLAG_DEFINITION);
+        if(test_symbols[i].usr != NULL)
+            store_register_usr(store, id, test_symbols[i].usr);
+        if(test_symbols[i].doc != NULL)
+            store_register_doc(store, id, test_symbols[i].doc);
+        if(test_symbols[i].ref != NULL) {
+            ref = test_symbols[i].ref;
+            store_register_refs(store, id, &ref, 1);
+        }
+        if(test_symbols[i].parent != NULL)
+            store_register_parent(store, id, store_lookup_symbol(store, test_symbols[i].parent));
+    }
+
+    /* A symbol declared in more files is listed in each of them. */
+    id = store_register_function(store, files[3], "foo", "foo(int)");
+    TEST_CHECK(id == store_lookup_symbol(store, "foo(int)"));
+
+    store_link(store);
+}
+
+static void
+test_lookups(void)
+{
+    STORE store;
+    TEST_RECORD before[TEST_N_SYMBOLS], after[TEST_N_SYMBOLS];
+    TEST_RECORD usr_before[TEST_N_SYMBOLS], usr_after[TEST_N_SYMBOLS];
+    STORE_ID files_before[TEST_N_FILES], files_after[TEST_N_FILES];
+    size_t n_before[TEST_N_FILES], n_after[TEST_N_FILES];
+    size_t i;
+
+    store_init(&store);
+    test_fill(&store);
+    test_lookup_all(&store, before, usr_before, files_before, n_before);
+
+    store_freeze(&store);
+    TEST_CHECK(store_is_frozen(&store));
+    test_lookup_all(&store, after, usr_after, files_after, n_after);
+
+    for(i = 0; i < TEST_N_SYMBOLS; i++) {
+        if(strcmp(before[i].desc, after[i].desc) != 0) {
+            fprintf(stderr, "Lookup of %s: was '%s', is '%s' when frozen.\n",
+                    test_symbols[i].long_name, before[i].desc, after[i].desc);
+            n_failures++;
+        }
+        TEST_CHECK(strcmp(usr_before[i].desc, usr_after[i].desc) == 0);
+    }
+    for(i = 0; i < TEST_N_FILES; i++)
+        TEST_CHECK(n_before[i] == n_after[i]);
+
+    /* Frozen files are sorted by path. */
+    for(i = 1; i < store_file_count(&store); i++)
+        TEST_CHECK(strcmp(store_file_path(&store, i-1), store_file_path(&store, i)) < 0);
+
+    store_fini(&store);
+}
+
+
+/* Check the query result is exactly the set of symbols a full scan finds,
+ * in the documented order. */
+typedef int (*TEST_MATCH)(const STORE* store, STORE_ID id, const void* arg);
+typedef int (*TEST_BEFORE)(const STORE* store, STORE_ID a, STORE_ID b);
+
+static void
+test_expect_query(const STORE* store, const char* what, const STORE_ID* ids, size_t n,
+                  TEST_MATCH match, const void* arg, TEST_BEFORE before)
+{
+    size_t i, n_expected = 0;
+    STORE_ID id;
+
+    for(id = 0; id < store_symbol_count(store); id++) {
+        if(match(store, id, arg))
+            n_expected++;
+    }
+    if(n != n_expected) {
+        fprintf(stderr, "Query %s: expected %u symbols, got %u.\n", what,
+                (unsigned) n_expected, (unsigned) n);
+        n_failures++;
+    }
+
+    for(i = 0; i < n; i++) {
+        if(!match(store, ids[i], arg)) {
+            fprintf(stderr, "Query %s: unexpected %s.\n", what, store_symbol_long_name(store, ids[i]));
+            n_failures++;
+        }
+        if(i > 0  &&  before != NULL  &&  !before(store, ids[i-1], ids[i])) {
+            fprintf(stderr, "Query %s: %s and %s are out of order.\n", what,
+                    store_symbol_long_name(store, ids[i-1]), store_symbol_long_name(store, ids[i]));
+            n_failures++;
+        }
+    }
+}
+
+static int
+test_match_name(const STORE* store, STORE_ID id, const void* arg)
+{
+    return (strcmp(store_symbol_name(store, id), (const char*) arg) == 0);
+}
+
+static int
+test_match_prefix(const STORE* store, STORE_ID id, const void* arg)
+{
+    return (strncmp(store_symbol_name(store, id), (const char*) arg, strlen((const char*) arg)) == 0);
+}
+
+static int
+test_match_kind(const STORE* store, STORE_ID id, const void* arg)
+{
+    return (store_symbol_kind(store, id) == *(const unsigned*) arg);
+}
+
+static int
+test_match_file(const STORE* store, STORE_ID id, const void* arg)
+{
+    /* Unfrozen list of the file's symbols. (Unlike files, symbols keep their
+     * IDs.) */
+    const STORE_ID* listed = (const STORE_ID*) arg;
+    size_t i;
+
+    for(i = 0; listed[i] != STORE_NO_ID; i++) {
+        if(listed[i] == id)
+            return 1;
+    }
+    return 0;
+}
+
+static int
+test_before_name(const STORE* store, STORE_ID a, STORE_ID b)
+{
+    int cmp = strcmp(store_symbol_name(store, a), store_symbol_name(store, b));
+    return (cmp < 0  ||  (cmp == 0  &&
+            strcmp(store_symbol_long_name(store, a), store_symbol_long_name(store, b)) < 0));
+}
+
+static int
+test_before_long_name(const STORE* store, STORE_ID a, STORE_ID b)
+{
+    return (strcmp(store_symbol_long_name(store, a), store_symbol_long_name(store, b)) < 0);
+}
+
+static int
+test_before_kind(const STORE* store, STORE_ID a, STORE_ID b)
+{
+    if(store_symbol_kind(store, a) != store_symbol_kind(store, b))
+        return (store_symbol_kind(store, a) < store_symbol_kind(store, b));
+    return test_before_long_name(store, a, b);
+}
+
+static void
+test_queries(void)
+{
+    static const char* names[] = { "foo", "food", "point", "abc", "fo", "" , "zzz" };
+    static const char* prefixes[] = { "fo", "foo", "f", "p", "", "zzz", "foods" };
+    STORE store;
+    STORE_ID listed[TEST_N_FILES][TEST_N_SYMBOLS + 2];
+    const STORE_ID* ids;
+    STORE_ID file;
+    size_t i, j, n, pass;
+    unsigned kind;
+    char what[64];
+
+    store_init(&store);
+    test_fill(&store);
+
+    /* Remember what the files list before freezing. */
+    for(i = 0; i < TEST_N_FILES; i++) {
+        const STORE_FILE* f = store_file(&store, store_lookup_file(&store, test_files[i]));
+        for(j = 0; j < f->n_symbols; j++)
+            listed[i][j] = f->symbols[j];
+        listed[i][j] = STORE_NO_ID;
+    }
+
+    store_freeze(&store);
+
+    /* The second pass gets the indexes built by the first one. */
+    for(pass = 0; pass < 2; pass++) {
+        for(i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            n = store_query_name(&store, names[i], &ids);
+            snprintf(what, sizeof(what), "name '%s'", names[i]);
+            test_expect_query(&store, what, ids, n, test_match_name, names[i], NULL);
+        }
+        for(i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+            n = store_query_prefix(&store, prefixes[i], &ids);
+            snprintf(what, sizeof(what), "prefix '%s'", prefixes[i]);
+            test_expect_query(&store, what, ids, n, test_match_prefix, prefixes[i], test_before_name);
+        }
+        for(kind = 1; kind <= STORE_KIND_MAX; kind++) {
+            n = store_query_kind(&store, kind, &ids);
+            snprintf(what, sizeof(what), "kind %u", kind);
+            test_expect_query(&store, what, ids, n, test_match_kind, &kind, test_before_long_name);
+        }
+        for(i = 0; i < TEST_N_FILES; i++) {
+            file = store_lookup_file(&store, test_files[i]);
+            n = store_query_file(&store, file, &ids);
+            snprintf(what, sizeof(what), "file '%s'", test_files[i]);
+            test_expect_query(&store, what, ids, n, test_match_file, listed[i], test_before_kind);
+        }
+    }
+
+    store_fini(&store);
+}
+
+
+int
+main(int argc, char** argv)
+{
+    test_lookups();
+    test_queries();
+
+    if(n_failures > 0) {
+        fprintf(stderr, "%d check(s) failed.\n", n_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
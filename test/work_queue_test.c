@@ -0,0 +1,203 @@
+/*
+ * DocBaker
+ * (http://github.com/mity/docbaker)
+ *
+ * Copyright (c) 2017 Martin Mitas
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Test of the bounded cost-ordered work queue: the order in which items
+ * come out, and blocking of the producer and of consumers. */
+
+#include "misc.h"
+#include "thread_util.h"
+#include "work_queue.h"
+
+
+int verbose_level = 0;
+
+static int n_failures = 0;
+
+#define TEST_CHECK(cond)                                                    \
+    do {                                                                    \
+        if(!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+            n_failures++;                                                   \
+        }                                                                   \
+    } while(0)
+
+
+#define TEST_N_ITEMS            12
+
+static const uint64_t test_costs[TEST_N_ITEMS] = { 3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8 };
+static int test_items[TEST_N_ITEMS];
+
+
+/* Items have to come out the most expensive first, and those of the same
+ * cost in the order they have been pushed. */
+static void
+test_order(void)
+{
+    WORK_QUEUE queue;
+    int* item;
+    int* prev = NULL;
+    int i;
+
+    work_queue_init(&queue, TEST_N_ITEMS);
+    for(i = 0; i < TEST_N_ITEMS; i++)
+        TEST_CHECK(work_queue_push(&queue, &test_items[i], test_costs[i]) == (size_t) i + 1);
+    work_queue_close(&queue);
+
+    for(i = 0; i < TEST_N_ITEMS; i++) {
+        item = (int*) work_queue_pop(&queue);
+        TEST_CHECK(item != NULL);
+        if(item == NULL)
+            break;
+        if(prev != NULL) {
+            uint64_t prev_cost = test_costs[*prev];
+            uint64_t cost = test_costs[*item];
+            TEST_CHECK(prev_cost > cost  ||  (prev_cost == cost  &&  *prev < *item));
+        }
+        prev = item;
+    }
+
+    /* Closed and drained. */
+    TEST_CHECK(work_queue_pop(&queue) == NULL);
+    TEST_CHECK(queue.max_count == TEST_N_ITEMS);
+    TEST_CHECK(queue.n_push_waits == 0);
+    TEST_CHECK(queue.n_pop_waits == 0);
+    work_queue_fini(&queue);
+}
+
+
+typedef struct TEST_PRODUCER {
+    WORK_QUEUE* queue;
+    int is_done;            /* Guarded by queue->mutex. */
+} TEST_PRODUCER;
+
+static void
+test_producer_thread(void* arg)
+{
+    TEST_PRODUCER* producer = (TEST_PRODUCER*) arg;
+
+    work_queue_push(producer->queue, &test_items[2], 1);
+
+    mutex_lock(&producer->queue->mutex);
+    producer->is_done = 1;
+    mutex_unlock(&producer->queue->mutex);
+}
+
+static void
+test_consumer_thread(void* arg)
+{
+    WORK_QUEUE* queue = (WORK_QUEUE*) arg;
+
+    TEST_CHECK(work_queue_pop(queue) == &test_items[3]);
+}
+
+/* Wait until *counter (guarded by the queue's mutex) becomes non-zero. */
+static void
+test_wait_for(WORK_QUEUE* queue, const unsigned* counter)
+{
+    unsigned value;
+
+    do {
+        mutex_lock(&queue->mutex);
+        value = *counter;
+        mutex_unlock(&queue->mutex);
+    } while(value == 0);
+}
+
+/* A producer pushing into a full queue has to wait until a consumer takes
+ * something out. */
+static void
+test_full(void)
+{
+    WORK_QUEUE queue;
+    TEST_PRODUCER producer = { &queue, 0 };
+    THREAD thread;
+    int is_done;
+
+    work_queue_init(&queue, 2);
+    work_queue_push(&queue, &test_items[0], 1);
+    work_queue_push(&queue, &test_items[1], 1);
+
+    thread_create(&thread, test_producer_thread, &producer);
+    test_wait_for(&queue, &queue.n_push_waits);
+
+    /* The producer is stuck in work_queue_push(). */
+    mutex_lock(&queue.mutex);
+    is_done = producer.is_done;
+    TEST_CHECK(queue.count == 2);
+    mutex_unlock(&queue.mutex);
+    TEST_CHECK(!is_done);
+
+    TEST_CHECK(work_queue_pop(&queue) == &test_items[0]);
+    thread_join(&thread);
+    TEST_CHECK(producer.is_done);
+    TEST_CHECK(queue.count == 2);
+    TEST_CHECK(queue.max_count == 2);
+    TEST_CHECK(queue.n_push_waits == 1);
+
+    work_queue_close(&queue);
+    TEST_CHECK(work_queue_pop(&queue) == &test_items[1]);
+    TEST_CHECK(work_queue_pop(&queue) == &test_items[2]);
+    TEST_CHECK(work_queue_pop(&queue) == NULL);
+    work_queue_fini(&queue);
+}
+
+/* A consumer popping from an empty queue has to wait until something is
+ * pushed. */
+static void
+test_empty(void)
+{
+    WORK_QUEUE queue;
+    THREAD thread;
+
+    work_queue_init(&queue, 2);
+    thread_create(&thread, test_consumer_thread, &queue);
+    test_wait_for(&queue, &queue.n_pop_waits);
+
+    work_queue_push(&queue, &test_items[3], 1);
+    thread_join(&thread);
+    TEST_CHECK(queue.count == 0);
+    TEST_CHECK(queue.n_pop_waits == 1);
+    work_queue_fini(&queue);
+}
+
+
+int
+main(int argc, char** argv)
+{
+    int i;
+
+    for(i = 0; i < TEST_N_ITEMS; i++)
+        test_items[i] = i;
+
+    test_order();
+    test_full();
+    test_empty();
+
+    if(n_failures > 0) {
+        fprintf(stderr, "%d check(s) failed.\n", n_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}